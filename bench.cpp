@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "bench.h"
+#include "compiler.h"
+#include "memory.h"
+#include "vm.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HAVE_PERF_EVENTS
+#endif
+
+#define COUNTER_COUNT 4
+
+static const char* const counterNames[COUNTER_COUNT] = {
+    "cycles", "instructions", "branch-misses", "cache-misses",
+};
+
+/*
+* One perf event per counter, each opened on its own so that a counter the
+* CPU or kernel does not offer only drops that counter. Counts are user
+* space only, which perf_event_paranoid allows by default.
+*/
+typedef struct {
+    int fds[COUNTER_COUNT];
+    // Sums over every measured run; counted is false when a counter never
+    // got scheduled onto the PMU.
+    uint64_t totals[COUNTER_COUNT];
+    bool counted[COUNTER_COUNT];
+    int available;
+    const char* unavailableReason;
+} Counters;
+
+#ifdef HAVE_PERF_EVENTS
+static const uint64_t counterConfigs[COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_HW_CACHE_MISSES,
+};
+
+static int openEvent(uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+static void openCounters(Counters* counters) {
+    counters->available = 0;
+    counters->unavailableReason = "not supported on this platform";
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        counters->fds[i] = -1;
+#ifdef HAVE_PERF_EVENTS
+        counters->fds[i] = openEvent(counterConfigs[i]);
+        if (counters->fds[i] >= 0) {
+            counters->available++;
+        }
+        else {
+            counters->unavailableReason = strerror(errno);
+        }
+#endif
+    }
+}
+
+static void resetCounters(Counters* counters) {
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        counters->totals[i] = 0;
+        counters->counted[i] = false;
+    }
+}
+
+static void startCounters(Counters* counters) {
+#ifdef HAVE_PERF_EVENTS
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (counters->fds[i] < 0) continue;
+        ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+    (void)counters;
+#endif
+}
+
+/*
+* Stop the counters and add this run's counts to the totals. When the
+* kernel had to multiplex events, the count is scaled up by the fraction of
+* the run it was actually measured for.
+*/
+static void stopCounters(Counters* counters) {
+#ifdef HAVE_PERF_EVENTS
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (counters->fds[i] < 0) continue;
+        ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t values[3];
+        if (read(counters->fds[i], values, sizeof(values)) != sizeof(values)) {
+            continue;
+        }
+        if (values[2] == 0) continue;
+        double scale = (double)values[1] / (double)values[2];
+        counters->totals[i] += (uint64_t)((double)values[0] * scale);
+        counters->counted[i] = true;
+    }
+#else
+    (void)counters;
+#endif
+}
+
+static void closeCounters(Counters* counters) {
+#ifdef HAVE_PERF_EVENTS
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (counters->fds[i] >= 0) close(counters->fds[i]);
+    }
+#else
+    (void)counters;
+#endif
+}
+
+static void printCounters(Counters* counters, int runs) {
+    if (counters->available == 0) {
+        fprintf(stderr, "  counters unavailable: %s\n",
+            counters->unavailableReason);
+        return;
+    }
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (!counters->counted[i]) {
+            fprintf(stderr, "  %-14s %16s\n", counterNames[i], "n/a");
+            continue;
+        }
+        fprintf(stderr, "  %-14s %16.0f\n", counterNames[i],
+            (double)counters->totals[i] / runs);
+    }
+    // cycles and instructions are the first two counters.
+    if (counters->counted[0] && counters->counted[1] && counters->totals[0] != 0) {
+        fprintf(stderr, "  %-14s %16.2f\n", "IPC",
+            (double)counters->totals[1] / (double)counters->totals[0]);
+    }
+}
+
+static uint64_t monotonicNanos() {
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<nanoseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+// Nearest-rank percentile of an ascending array.
+static uint64_t percentile(const uint64_t* sorted, int count, int percent) {
+    int rank = (int)(((int64_t)count * percent + 99) / 100);
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+int benchSource(const char* source, int iterations) {
+    Counters counters;
+    openCounters(&counters);
+
+    Chunk chunk;
+    initChunk(&chunk);
+    resetCounters(&counters);
+    // Timestamps are taken inside the counter window so that the perf
+    // syscalls are not part of the measured time.
+    startCounters(&counters);
+    uint64_t compileStart = monotonicNanos();
+    bool compiled = Compiler::compile(source, &chunk);
+    uint64_t compileNanos = monotonicNanos() - compileStart;
+    stopCounters(&counters);
+    if (!compiled) {
+        freeChunk(&chunk);
+        closeCounters(&counters);
+        return 65;
+    }
+
+    // Objects from here on are made by a run and freed right after it, so
+    // the heap is the same size for every run.
+    Obj* compiledObjects = vm.objects;
+
+    // Warm the caches and branch predictors before anything is measured.
+    int warmup = iterations / 10 + 1;
+    for (int i = 0; i < warmup; i++) {
+        InterpretResult result = interpretChunk(&chunk);
+        freeObjectsSince(compiledObjects);
+        if (result != INTERPRET_OK) {
+            freeChunk(&chunk);
+            closeCounters(&counters);
+            return 70;
+        }
+    }
+
+    // Only the measured runs go into the profile.
+    memset(vm.profile, 0, sizeof(vm.profile));
+
+    fprintf(stderr, "compile: %.2f us\n", compileNanos / 1000.0);
+    printCounters(&counters, 1);
+
+    uint64_t* durations = GROW_ARRAY(uint64_t, NULL, 0, iterations);
+    resetCounters(&counters);
+    int exitCode = 0;
+    for (int i = 0; i < iterations; i++) {
+        startCounters(&counters);
+        uint64_t start = monotonicNanos();
+        InterpretResult result = interpretChunk(&chunk);
+        durations[i] = monotonicNanos() - start;
+        stopCounters(&counters);
+        freeObjectsSince(compiledObjects);
+        if (result != INTERPRET_OK) {
+            exitCode = 70;
+            break;
+        }
+    }
+
+    if (exitCode == 0) {
+        std::sort(durations, durations + iterations);
+        fprintf(stderr, "execute: %d runs after %d warmup, counters per run\n",
+            iterations, warmup);
+        fprintf(stderr, "  min %.2f us  median %.2f us  p99 %.2f us\n",
+            durations[0] / 1000.0,
+            percentile(durations, iterations, 50) / 1000.0,
+            percentile(durations, iterations, 99) / 1000.0);
+        printCounters(&counters, iterations);
+        if (vm.diagnostics & DIAG_PROFILE) dumpProfile();
+    }
+
+    FREE_ARRAY(uint64_t, durations, iterations);
+    freeChunk(&chunk);
+    closeCounters(&counters);
+    return exitCode;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "common.h"
+
+/*
+* Compile source once, run it `iterations` times after a warmup and print
+* timings and hardware counters for each phase to stderr. Returns the
+* process exit code.
+*/
+int benchSource(const char* source, int iterations);
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "chunk.h"
 #include "memory.h"
@@ -9,10 +10,18 @@ void initChunk(Chunk* chunk) {
 	chunk->code = NULL;
     chunk->lines = NULL;
     initValueArray(&chunk->constants);
+    chunk->block = NULL;
 }
 
 void freeChunk(Chunk* chunk)
 {
+    if (chunk->block != NULL) {
+        // Code and constants live inside the packed block.
+        freeAligned(chunk->block);
+        FREE_ARRAY(int, chunk->lines, chunk->capacity);
+        initChunk(chunk);
+        return;
+    }
     FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
     FREE_ARRAY(int, chunk->lines, chunk->capacity);
     freeValueArray(&chunk->constants);
@@ -43,3 +52,45 @@ int addConstant(Chunk* chunk, Value value)
     //
     return chunk->constants.count - 1;
 }
+
+/*
+* Grow the chunk up front to the expected size so compiling a large source
+* does not go through repeated doubling.
+*/
+void reserveChunk(Chunk* chunk, int codeCapacity, int constantCapacity)
+{
+    if (chunk->capacity < codeCapacity) {
+        chunk->code = GROW_ARRAY(uint8_t, chunk->code,
+            chunk->capacity, codeCapacity);
+        chunk->lines = GROW_ARRAY(int, chunk->lines,
+            chunk->capacity, codeCapacity);
+        chunk->capacity = codeCapacity;
+    }
+    reserveValueArray(&chunk->constants, constantCapacity);
+}
+
+/*
+* Pack the finished chunk into a single cache-line-aligned block with no
+* slack: constants first, then code. The line table is only read on errors
+* and when disassembling, so it is shrunk in place and kept apart.
+* A finalized chunk must not be written to again.
+*/
+void finalizeChunk(Chunk* chunk)
+{
+    size_t constantBytes = sizeof(Value) * chunk->constants.count;
+    uint8_t* block = (uint8_t*)allocateAligned(constantBytes + chunk->count);
+    memcpy(block, chunk->constants.values, constantBytes);
+    memcpy(block + constantBytes, chunk->code, chunk->count);
+
+    FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+    freeValueArray(&chunk->constants);
+    chunk->lines = GROW_ARRAY(int, chunk->lines,
+        chunk->capacity, chunk->count);
+
+    chunk->block = block;
+    chunk->code = block + constantBytes;
+    chunk->capacity = chunk->count;
+    chunk->constants.values = (Value*)block;
+    chunk->constants.count = (int)(constantBytes / sizeof(Value));
+    chunk->constants.capacity = chunk->constants.count;
+}
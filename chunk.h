@@ -9,6 +9,18 @@ typedef enum {
 	OP_MULTIPLY,
 	OP_DIVIDE,
 	OP_NEGATE,
+	// Operands proven numeric at compile time; no type checks.
+	OP_ADD_NN,
+	OP_SUBTRACT_NN,
+	OP_MULTIPLY_NN,
+	OP_DIVIDE_NN,
+	OP_NEGATE_N,
+	// Packs the top n numbers (n is the operand byte) into an array.
+	OP_ARRAY,
+	OP_SUM,
+	OP_MIN,
+	OP_MAX,
+	OP_DOT,
 	OP_RETURN,
 } OpCode;
 
@@ -20,9 +32,14 @@ typedef struct {
 	int* lines;
 	//
 	ValueArray constants;
+	// Set by finalizeChunk(): one cache-line-aligned allocation holding
+	// the constants followed by the code. Lines stay in their own array.
+	uint8_t* block;
 } Chunk;
 
 void initChunk(Chunk* chunk);
 void freeChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
-int addConstant(Chunk* chunk, Value value);
\ No newline at end of file
+int addConstant(Chunk* chunk, Value value);
+void reserveChunk(Chunk* chunk, int codeCapacity, int constantCapacity);
+void finalizeChunk(Chunk* chunk);
\ No newline at end of file
@@ -0,0 +1,397 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "codegen.h"
+#include "object.h"
+
+/*
+* Runtime for the generated translation unit. It must stay standalone, so
+* the integer helpers repeat the ones in value.h; keep them in step so the
+* native program computes exactly what the VM would.
+*/
+static const char* prelude = R"PRELUDE(#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum ValueType { VAL_NUMBER, VAL_INT, VAL_STRING, VAL_ARRAY };
+
+struct Value {
+    ValueType type;
+    double number;
+    int64_t integer;
+    std::string string;
+    std::vector<double> array;
+};
+
+const int64_t MAX_SAFE_INT = (int64_t)1 << 53;
+
+inline Value number(double n) { return Value{VAL_NUMBER, n, 0, std::string(), {}}; }
+inline Value integer(int64_t i) { return Value{VAL_INT, 0, i, std::string(), {}}; }
+inline Value string(const char* chars) { return Value{VAL_STRING, 0, 0, chars, {}}; }
+
+inline Value array(std::vector<double> elements) {
+    return Value{VAL_ARRAY, 0, 0, std::string(), std::move(elements)};
+}
+
+inline bool isNumber(const Value& value) {
+    return value.type == VAL_NUMBER || value.type == VAL_INT;
+}
+
+inline double asNumber(const Value& value) {
+    return value.type == VAL_INT ? (double)value.integer : value.number;
+}
+
+inline bool isSafeInt(int64_t i) { return i >= -MAX_SAFE_INT && i <= MAX_SAFE_INT; }
+
+inline bool addInts(int64_t a, int64_t b, int64_t* result) {
+    *result = a + b;
+    return isSafeInt(*result);
+}
+
+inline bool subtractInts(int64_t a, int64_t b, int64_t* result) {
+    *result = a - b;
+    return isSafeInt(*result);
+}
+
+inline bool multiplyInts(int64_t a, int64_t b, int64_t* result) {
+    double estimate = (double)a * (double)b;
+    if (estimate > 4.0 * MAX_SAFE_INT || estimate < -4.0 * MAX_SAFE_INT) return false;
+    *result = a * b;
+    if (*result == 0 && (a < 0 || b < 0)) return false;
+    return isSafeInt(*result);
+}
+
+inline bool divideInts(int64_t a, int64_t b, int64_t* result) {
+    if (b == 0 || a % b != 0) return false;
+    *result = a / b;
+    if (*result == 0 && b < 0) return false;
+    return true;
+}
+
+[[noreturn]] void runtimeError(const char* message, int line) {
+    fprintf(stderr, "%s\n[line %d] in script\n", message, line);
+    exit(70);
+}
+
+inline Value makeArray(std::initializer_list<Value> elements, int line) {
+    std::vector<double> values;
+    for (const Value& element : elements) {
+        if (!isNumber(element)) runtimeError("Array elements must be numbers.", line);
+        values.push_back(asNumber(element));
+    }
+    return array(std::move(values));
+}
+
+// Element-wise arithmetic with at least one array operand; a number is
+// applied to every element, as in the VM.
+template <typename Op>
+Value elementwise(const Value& a, const Value& b, int line, Op op) {
+    bool aIsArray = a.type == VAL_ARRAY;
+    bool bIsArray = b.type == VAL_ARRAY;
+    if ((!aIsArray && !isNumber(a)) || (!bIsArray && !isNumber(b))) {
+        runtimeError("Operands must be numbers or arrays.", line);
+    }
+    if (aIsArray && bIsArray && a.array.size() != b.array.size()) {
+        runtimeError("Array lengths must match.", line);
+    }
+    size_t count = aIsArray ? a.array.size() : b.array.size();
+    std::vector<double> values(count);
+    for (size_t i = 0; i < count; i++) {
+        values[i] = op(aIsArray ? a.array[i] : asNumber(a),
+            bIsArray ? b.array[i] : asNumber(b));
+    }
+    return array(std::move(values));
+}
+
+#define NUMBER_OP(name, op, intOp) \
+    inline Value name##NN(const Value& a, const Value& b) { \
+        int64_t result; \
+        if (a.type == VAL_INT && b.type == VAL_INT && \
+            intOp(a.integer, b.integer, &result)) { \
+            return integer(result); \
+        } \
+        return number(asNumber(a) op asNumber(b)); \
+    } \
+    inline Value name(const Value& a, const Value& b, int line) { \
+        if (a.type == VAL_ARRAY || b.type == VAL_ARRAY) { \
+            return elementwise(a, b, line, [](double x, double y) { return x op y; }); \
+        } \
+        if (!isNumber(a) || !isNumber(b)) { \
+            runtimeError("Operands must be numbers.", line); \
+        } \
+        return name##NN(a, b); \
+    }
+
+NUMBER_OP(subtract, -, subtractInts)
+NUMBER_OP(multiply, *, multiplyInts)
+NUMBER_OP(divide, /, divideInts)
+
+inline Value addNN(const Value& a, const Value& b) {
+    int64_t result;
+    if (a.type == VAL_INT && b.type == VAL_INT && addInts(a.integer, b.integer, &result)) {
+        return integer(result);
+    }
+    return number(asNumber(a) + asNumber(b));
+}
+
+inline Value add(const Value& a, const Value& b, int line) {
+    if (a.type == VAL_STRING && b.type == VAL_STRING) {
+        return Value{VAL_STRING, 0, 0, a.string + b.string, {}};
+    }
+    if (isNumber(a) && isNumber(b)) return addNN(a, b);
+    if (a.type == VAL_ARRAY || b.type == VAL_ARRAY) {
+        return elementwise(a, b, line, [](double x, double y) { return x + y; });
+    }
+    runtimeError("Operands must be two numbers or two strings.", line);
+}
+
+inline Value negateN(const Value& a) {
+    if (a.type == VAL_INT && a.integer != 0) return integer(-a.integer);
+    return number(-asNumber(a));
+}
+
+inline Value negate(const Value& a, int line) {
+    if (a.type == VAL_ARRAY) {
+        std::vector<double> values(a.array.size());
+        for (size_t i = 0; i < values.size(); i++) values[i] = -a.array[i];
+        return array(std::move(values));
+    }
+    if (!isNumber(a)) runtimeError("Operand must be a number.", line);
+    return negateN(a);
+}
+
+// Plain left-to-right loops: the VM's vector kernels may round sums and
+// dot products differently in the last bits.
+inline Value sum(const Value& a, int line) {
+    if (a.type != VAL_ARRAY) runtimeError("Operand must be an array.", line);
+    double result = 0;
+    for (double x : a.array) result += x;
+    return number(result);
+}
+
+inline Value dot(const Value& a, const Value& b, int line) {
+    if (a.type != VAL_ARRAY || b.type != VAL_ARRAY) {
+        runtimeError("Operands must be arrays.", line);
+    }
+    if (a.array.size() != b.array.size()) runtimeError("Array lengths must match.", line);
+    double result = 0;
+    for (size_t i = 0; i < a.array.size(); i++) result += a.array[i] * b.array[i];
+    return number(result);
+}
+
+template <typename Better>
+Value extreme(const Value& a, int line, Better better) {
+    if (a.type != VAL_ARRAY) runtimeError("Operand must be an array.", line);
+    if (a.array.empty()) runtimeError("Array must not be empty.", line);
+    double result = a.array[0];
+    for (double x : a.array) {
+        if (better(x, result)) result = x;
+    }
+    return number(result);
+}
+
+inline Value min(const Value& a, int line) {
+    return extreme(a, line, [](double x, double m) { return x < m; });
+}
+
+inline Value max(const Value& a, int line) {
+    return extreme(a, line, [](double x, double m) { return x > m; });
+}
+
+void printValue(const Value& value) {
+    switch (value.type) {
+        case VAL_NUMBER: printf("%g", value.number); break;
+        case VAL_INT: printf("%g", (double)value.integer); break;
+        case VAL_STRING: printf("%s", value.string.c_str()); break;
+        case VAL_ARRAY:
+            printf("[");
+            for (size_t i = 0; i < value.array.size(); i++) {
+                if (i > 0) printf(", ");
+                printf("%g", value.array[i]);
+            }
+            printf("]");
+            break;
+    }
+}
+
+}
+)PRELUDE";
+
+static void emitString(FILE* out, ObjString* string) {
+    fputc('"', out);
+    for (int i = 0; i < string->length; i++) {
+        unsigned char c = (unsigned char)string->chars[i];
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20 || c >= 0x7f) fprintf(out, "\\%03o", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static bool emitConstant(FILE* out, Value value) {
+    switch (value.type) {
+        case VAL_INT:
+            fprintf(out, "integer(INT64_C(%lld))", (long long)AS_INT(value));
+            return true;
+        case VAL_NUMBER:
+            if (isinf(AS_NUMBER(value))) {
+                fprintf(out, "number(%sHUGE_VAL)", AS_NUMBER(value) < 0 ? "-" : "");
+            }
+            else {
+                fprintf(out, "number(%.17g)", AS_NUMBER(value));
+            }
+            return true;
+        case VAL_OBJ:
+            if (!IS_STRING(value)) return false;
+            fprintf(out, "string(");
+            emitString(out, AS_STRING(value));
+            fprintf(out, ")");
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+* Walk the bytecode once to find how deep the operand stack gets; each
+* slot becomes a local in the generated function.
+*/
+static int maxStackDepth(Chunk* chunk) {
+    int depth = 0;
+    int maxDepth = 0;
+    for (int offset = 0; offset < chunk->count;) {
+        switch (chunk->code[offset]) {
+            case OP_CONSTANT:
+                depth++;
+                offset += 2;
+                break;
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_ADD_NN:
+            case OP_SUBTRACT_NN:
+            case OP_MULTIPLY_NN:
+            case OP_DIVIDE_NN:
+            case OP_DOT:
+            case OP_RETURN:
+                depth--;
+                offset++;
+                break;
+            case OP_ARRAY:
+                depth -= chunk->code[offset + 1] - 1;
+                offset += 2;
+                break;
+            default:
+                offset++;
+                break;
+        }
+        if (depth > maxDepth) maxDepth = depth;
+    }
+    return maxDepth;
+}
+
+/*
+* Translate a compiled chunk into a standalone C++ program. The operand
+* stack becomes locals s0..sN, constants are inlined, and each operation
+* carries its source line for runtime errors. Returns false if the chunk
+* uses something the translator does not handle.
+*/
+bool emitCpp(Chunk* chunk, const char* sourceName, FILE* out) {
+    fprintf(out, "// Generated by clox --emit-cpp from %s.\n", sourceName);
+    fputs(prelude, out);
+    fprintf(out, "\nint main() {\n");
+
+    int slots = maxStackDepth(chunk);
+    for (int i = 0; i < slots; i++) fprintf(out, "    Value s%d;\n", i);
+
+    static const char* const binaryNames[] = {
+        "add", "subtract", "multiply", "divide",
+    };
+
+    int depth = 0;
+    for (int offset = 0; offset < chunk->count;) {
+        uint8_t instruction = chunk->code[offset];
+        int line = chunk->lines[offset];
+        switch (instruction) {
+            case OP_CONSTANT: {
+                fprintf(out, "    s%d = ", depth);
+                if (!emitConstant(out, chunk->constants.values[chunk->code[offset + 1]])) {
+                    return false;
+                }
+                fprintf(out, ";\n");
+                depth++;
+                offset += 2;
+                break;
+            }
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+                fprintf(out, "    s%d = %s(s%d, s%d, %d);\n", depth - 2,
+                    binaryNames[instruction - OP_ADD], depth - 2, depth - 1, line);
+                depth--;
+                offset++;
+                break;
+            case OP_ADD_NN:
+            case OP_SUBTRACT_NN:
+            case OP_MULTIPLY_NN:
+            case OP_DIVIDE_NN:
+                fprintf(out, "    s%d = %sNN(s%d, s%d);\n", depth - 2,
+                    binaryNames[instruction - OP_ADD_NN], depth - 2, depth - 1);
+                depth--;
+                offset++;
+                break;
+            case OP_NEGATE:
+                fprintf(out, "    s%d = negate(s%d, %d);\n", depth - 1, depth - 1, line);
+                offset++;
+                break;
+            case OP_NEGATE_N:
+                fprintf(out, "    s%d = negateN(s%d);\n", depth - 1, depth - 1);
+                offset++;
+                break;
+            case OP_ARRAY: {
+                int count = chunk->code[offset + 1];
+                fprintf(out, "    s%d = makeArray({", depth - count);
+                for (int i = depth - count; i < depth; i++) {
+                    fprintf(out, i > depth - count ? ", s%d" : "s%d", i);
+                }
+                fprintf(out, "}, %d);\n", line);
+                depth = depth - count + 1;
+                offset += 2;
+                break;
+            }
+            case OP_SUM:
+            case OP_MIN:
+            case OP_MAX:
+                fprintf(out, "    s%d = %s(s%d, %d);\n", depth - 1,
+                    instruction == OP_SUM ? "sum" : instruction == OP_MIN ? "min" : "max",
+                    depth - 1, line);
+                offset++;
+                break;
+            case OP_DOT:
+                fprintf(out, "    s%d = dot(s%d, s%d, %d);\n", depth - 2,
+                    depth - 2, depth - 1, line);
+                depth--;
+                offset++;
+                break;
+            case OP_RETURN:
+                fprintf(out, "    printValue(s%d);\n", depth - 1);
+                fprintf(out, "    printf(\"\\n\");\n");
+                fprintf(out, "    return 0;\n");
+                depth--;
+                offset++;
+                break;
+            default:
+                return false;
+        }
+    }
+
+    fprintf(out, "}\n");
+    return true;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "chunk.h"
+
+bool emitCpp(Chunk* chunk, const char* sourceName, FILE* out);
@@ -4,5 +4,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define DEBUG_PRINT_CODE
-#define DEBUG_TRACE_EXECUTION
\ No newline at end of file
+// Record every executed instruction into a binary ring buffer in the VM,
+// decoded by dumpTrace() on a runtime error or a fatal signal. Runs only
+// pay for it while DIAG_RING is set, which it is by default.
+#define DEBUG_TRACE_RING
+#define TRACE_RING_SIZE 4096
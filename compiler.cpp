@@ -1,11 +1,12 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "common.h"
 #include "compiler.h"
-
-#ifdef DEBUG_PRINT_CODE
+#include "memory.h"
+#include "object.h"
 #include "debug.h"
-#endif
 
 namespace Compiler {
 	Parser parser;
@@ -18,14 +19,26 @@ namespace Compiler {
 
 
 	bool compile(const char* source, Chunk* chunk) {
-		Scanner::initScanner(source);
+		parser.source = source;
+		Scanner::initTokenBuffer(&parser.tokens);
+		Scanner::scanAll(source, &parser.tokens);
+		parser.nextToken = 0;
+		parser.frameCount = 0;
+		parser.frameCapacity = 0;
+		parser.frames = NULL;
 		compilingChunk = chunk;
+		// No token emits more than two bytes or more than one constant.
+		int tokenCount = parser.tokens.count;
+		reserveChunk(chunk, tokenCount * 2,
+			tokenCount < UINT8_MAX + 1 ? tokenCount : UINT8_MAX + 1);
 		parser.hadError = false;
 		parser.panicMode = false;
 		advance();
 		expression();
 		consume(Scanner::TOKEN_EOF, "Expect end of expression.");
 		endCompiler();
+		Scanner::freeTokenBuffer(&parser.tokens);
+		FREE_ARRAY(ParseFrame, parser.frames, parser.frameCapacity);
 		return !parser.hadError;
 	}
 
@@ -34,7 +47,10 @@ namespace Compiler {
 		parser.previous = parser.current;
 
 		for (;;) {
-			parser.current = Scanner::scanToken();
+			parser.current = Scanner::tokenAt(parser.source, &parser.tokens,
+				parser.nextToken);
+			// The stream ends with TOKEN_EOF; keep returning it from there on.
+			if (parser.nextToken < parser.tokens.count - 1) parser.nextToken++;
 			if (parser.current.type != Scanner::TOKEN_ERROR) break;
 
 			errorAtCurrent(parser.current.start);
@@ -77,6 +93,12 @@ namespace Compiler {
 		errorAtCurrent(message);
 	}
 
+	static bool match(Scanner::TokenType type) {
+		if (parser.current.type != type) return false;
+		advance();
+		return true;
+	}
+
 	static void emitByte(uint8_t byte) {
 		writeChunk(currentChunk(), byte, parser.previous.line);
 	}
@@ -88,115 +110,288 @@ namespace Compiler {
 
 	static void endCompiler() {
 		emitReturn();
-#ifdef DEBUG_PRINT_CODE
-		if (!parser.hadError) {
+		finalizeChunk(currentChunk());
+		if (!parser.hadError && (vm.diagnostics & DIAG_PRINT_CODE)) {
 			disassembleChunk(currentChunk(), "code");
 		}
-#endif
 	}
 
-	static void binary() {
-		//׺㣬õһoperatorûмemitҲ
-		//ǽǰoperator+1ΪСȼparsePrecedence
-		//ζиȼҪȼ㣬ҲǴ˴׺Ҳ͸ȼtoken
-		//Ҳ˵parsePrecedenceиȼoperatoremitӶʵֱoperatorȼ
-		//ȻǵݹǶ
-		Scanner::TokenType operatorType = parser.previous.type;
-		ParseRule* rule = getRule(operatorType);
-		parsePrecedence((Precedence)(rule->precedence + 1));
-
+	static void emitBinary(Scanner::TokenType operatorType, StaticType leftType) {
+		// Both operands proven numeric: the operand checks can be skipped.
+		bool numeric = leftType == TYPE_NUMBER && parser.lastType == TYPE_NUMBER;
 		switch (operatorType) {
-			case Scanner::TOKEN_PLUS:          emitByte(OP_ADD); break;
-			case Scanner::TOKEN_MINUS:         emitByte(OP_SUBTRACT); break;
-			case Scanner::TOKEN_STAR:          emitByte(OP_MULTIPLY); break;
-			case Scanner::TOKEN_SLASH:         emitByte(OP_DIVIDE); break;
+			case Scanner::TOKEN_PLUS:
+				emitByte(numeric ? OP_ADD_NN : OP_ADD);
+				// Without proof, '+' may also be string concatenation.
+				parser.lastType = numeric ? TYPE_NUMBER : TYPE_UNKNOWN;
+				return;
+			case Scanner::TOKEN_MINUS:  emitByte(numeric ? OP_SUBTRACT_NN : OP_SUBTRACT); break;
+			case Scanner::TOKEN_STAR:   emitByte(numeric ? OP_MULTIPLY_NN : OP_MULTIPLY); break;
+			case Scanner::TOKEN_SLASH:  emitByte(numeric ? OP_DIVIDE_NN : OP_DIVIDE); break;
 			default: return; // Unreachable.
 		}
+		// The remaining operators yield a number for numbers, but an array
+		// when either operand is one.
+		parser.lastType = numeric ? TYPE_NUMBER : TYPE_UNKNOWN;
 	}
 
-	static void grouping() {
-		expression();
-		consume(Scanner::TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+	static void pushFrame(FrameKind kind, Scanner::TokenType operatorType,
+		StaticType leftType, Precedence precedence) {
+		if (parser.frameCapacity < parser.frameCount + 1) {
+			int oldCapacity = parser.frameCapacity;
+			parser.frameCapacity = GROW_CAPACITY(oldCapacity);
+			parser.frames = GROW_ARRAY(ParseFrame, parser.frames,
+				oldCapacity, parser.frameCapacity);
+		}
+		ParseFrame* frame = &parser.frames[parser.frameCount++];
+		frame->kind = kind;
+		frame->operatorType = operatorType;
+		frame->leftType = leftType;
+		frame->precedence = precedence;
+		frame->count = 0;
+		frame->native = -1;
 	}
 
 	static void number() {
+		// Literals without a fractional part start out as integers.
+		if (memchr(parser.previous.start, '.', parser.previous.length) == NULL) {
+			char* end;
+			errno = 0;
+			long long value = strtoll(parser.previous.start, &end, 10);
+			if (errno == 0 && isSafeInt(value)) {
+				emitConstant(INT_VAL(value));
+				parser.lastType = TYPE_NUMBER;
+				return;
+			}
+		}
 		double value = strtod(parser.previous.start, NULL);
 		emitConstant(NUMBER_VAL(value));
+		parser.lastType = TYPE_NUMBER;
+	}
+
+	static void finishArray(int count) {
+		consume(Scanner::TOKEN_RIGHT_BRACKET, "Expect ']' after array elements.");
+		emitBytes(OP_ARRAY, (uint8_t)count);
+		parser.lastType = TYPE_UNKNOWN;
+	}
+
+	/*
+	* There are no functions or variables yet, so the array reductions are
+	* built in: an identifier is only valid as the name of one of these,
+	* immediately followed by its arguments.
+	*/
+	typedef struct {
+		const char* name;
+		int length;
+		int arity;
+		OpCode op;
+	} Native;
+
+	static const Native natives[] = {
+		{"sum", 3, 1, OP_SUM},
+		{"min", 3, 1, OP_MIN},
+		{"max", 3, 1, OP_MAX},
+		{"dot", 3, 2, OP_DOT},
+	};
+
+	// Resolve the identifier just consumed and its '('. Returns -1 after
+	// reporting an unknown name.
+	static int findNative() {
+		for (int i = 0; i < (int)(sizeof(natives) / sizeof(natives[0])); i++) {
+			if (natives[i].length == parser.previous.length &&
+				memcmp(natives[i].name, parser.previous.start, natives[i].length) == 0) {
+				consume(Scanner::TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+				return i;
+			}
+		}
+		error("Unknown function.");
+		parser.lastType = TYPE_UNKNOWN;
+		return -1;
 	}
 
-	static void unary() {
-		Scanner::TokenType operatorType = parser.previous.type;
+	static void finishCall(int native, int argCount) {
+		const Native* found = &natives[native];
+		consume(Scanner::TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+		if (argCount != found->arity) {
+			error(found->arity == 1 ? "Expect 1 argument." : "Expect 2 arguments.");
+		}
+		emitByte(found->op);
+		parser.lastType = TYPE_NUMBER;
+	}
 
-		// Compile the operand.
-		parsePrecedence(PREC_UNARY);
+	static void string() {
+		// Trim the surrounding quotes.
+		emitConstant(OBJ_VAL(copyString(parser.previous.start + 1,
+			parser.previous.length - 2)));
+		parser.lastType = TYPE_UNKNOWN;
+	}
 
+	static void emitUnary(Scanner::TokenType operatorType) {
 		// Emit the operator instruction.
 		switch (operatorType) {
-			case Scanner::TOKEN_MINUS: emitByte(OP_NEGATE); break;
+			case Scanner::TOKEN_MINUS:
+				// Negating an array gives an array, so only numbers stay proven.
+				emitByte(parser.lastType == TYPE_NUMBER ? OP_NEGATE_N : OP_NEGATE);
+				if (parser.lastType != TYPE_NUMBER) parser.lastType = TYPE_UNKNOWN;
+				break;
 			default: return; // Unreachable.
 		}
 	}
 
 	ParseRule rules[] = {
-			{grouping, NULL,   PREC_NONE}, // TOKEN_LEFT_PAREN
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_RIGHT_PAREN
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_LEFT_BRACE
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_RIGHT_BRACE
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_COMMA
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_DOT
-			{unary,    binary, PREC_TERM}, // TOKEN_MINUS
-			{NULL,     binary, PREC_TERM}, // TOKEN_PLUS
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_SEMICOLON
-			{NULL,     binary, PREC_FACTOR}, // TOKEN_SLASH
-			{NULL,     binary, PREC_FACTOR}, // TOKEN_STAR
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_BANG
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_BANG_EQUAL
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_EQUAL
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_EQUAL_EQUAL
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_GREATER
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_GREATER_EQUAL
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_LESS
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_LESS_EQUAL
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_IDENTIFIER
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_STRING
-			{number,   NULL,   PREC_NONE}, // TOKEN_NUMBER
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_AND
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_CLASS
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_ELSE
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_FALSE
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_FOR
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_FUN
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_IF
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_NIL
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_OR
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_PRINT
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_RETURN
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_SUPER
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_THIS
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_TRUE
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_VAR
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_WHILE
-			{NULL,     NULL,   PREC_NONE}, // TOKEN_ERROR
-			{NULL,     NULL,   PREC_NONE}  // TOKEN_EOF
+			{RULE_GROUPING, NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_LEFT_PAREN
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_RIGHT_PAREN
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_LEFT_BRACE
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_RIGHT_BRACE
+			{RULE_ARRAY,    NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_LEFT_BRACKET
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_RIGHT_BRACKET
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_COMMA
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_DOT
+			{RULE_UNARY,    NULL,   RULE_BINARY, PREC_TERM},   // TOKEN_MINUS
+			{RULE_NONE,     NULL,   RULE_BINARY, PREC_TERM},   // TOKEN_PLUS
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_SEMICOLON
+			{RULE_NONE,     NULL,   RULE_BINARY, PREC_FACTOR}, // TOKEN_SLASH
+			{RULE_NONE,     NULL,   RULE_BINARY, PREC_FACTOR}, // TOKEN_STAR
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_BANG
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_BANG_EQUAL
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_EQUAL
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_EQUAL_EQUAL
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_GREATER
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_GREATER_EQUAL
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_LESS
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_LESS_EQUAL
+			{RULE_CALL,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_IDENTIFIER
+			{RULE_LEAF,     string, RULE_NONE,   PREC_NONE},   // TOKEN_STRING
+			{RULE_LEAF,     number, RULE_NONE,   PREC_NONE},   // TOKEN_NUMBER
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_AND
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_CLASS
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_ELSE
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_FALSE
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_FOR
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_FUN
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_IF
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_NIL
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_OR
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_PRINT
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_RETURN
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_SUPER
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_THIS
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_TRUE
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_VAR
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_WHILE
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE},   // TOKEN_ERROR
+			{RULE_NONE,     NULL,   RULE_NONE,   PREC_NONE}    // TOKEN_EOF
 	};
 
+	/*
+	* Iterative Pratt parser. Leaf rules are called directly. Rules with
+	* operands push a frame recording what to emit afterwards and parse the
+	* operand in place, so nesting depth is bounded by the heap rather than
+	* the C stack.
+	*/
 	static void parsePrecedence(Precedence precedence) {
-		//ǰߣ"token "
-		advance();
-		//ǰߺ󣬻عǰһ"token"ͣȡǰһ"token"ǰ׺
-		ParseFn prefixRule = getRule(parser.previous.type)->prefix;
-		if (prefixRule == NULL) {
-			error("Expect expression.");
-			return;
-		}
-		//ִ"token"ǰ׺֣emitһֽ
-		prefixRule();
-		//"token "Ҳǵǰtokenprecedence͵ǰprecedenceȽ
-		//ǰtokenprecedence ڵڣwhile
-		while (precedence <= getRule(parser.current.type)->precedence) {
+		int base = parser.frameCount;
+		for (;;) {
+			//ǰߣ"token "
 			advance();
-			ParseFn infixRule = getRule(parser.previous.type)->infix;
-			infixRule();
+			//ǰߺ󣬻عǰһ"token"ͣȡǰһ"token"ǰ׺
+			ParseRule* prefixRule = getRule(parser.previous.type);
+			bool operand = true;
+			if (prefixRule->prefixKind == RULE_NONE) {
+				error("Expect expression.");
+				parser.lastType = TYPE_UNKNOWN;
+				// Like returning early: this level gets no infix operators.
+				operand = false;
+			}
+			else if (prefixRule->prefixKind == RULE_GROUPING) {
+				pushFrame(FRAME_GROUPING, parser.previous.type, TYPE_UNKNOWN, precedence);
+				precedence = PREC_ASSIGNMENT;
+				continue;
+			}
+			else if (prefixRule->prefixKind == RULE_UNARY) {
+				pushFrame(FRAME_UNARY, parser.previous.type, TYPE_UNKNOWN, precedence);
+				precedence = PREC_UNARY;
+				continue;
+			}
+			else if (prefixRule->prefixKind == RULE_ARRAY) {
+				if (parser.current.type == Scanner::TOKEN_RIGHT_BRACKET) {
+					finishArray(0);
+				}
+				else {
+					pushFrame(FRAME_ARRAY, parser.previous.type, TYPE_UNKNOWN, precedence);
+					precedence = PREC_ASSIGNMENT;
+					continue;
+				}
+			}
+			else if (prefixRule->prefixKind == RULE_CALL) {
+				int native = findNative();
+				if (native >= 0 && parser.current.type == Scanner::TOKEN_RIGHT_PAREN) {
+					finishCall(native, 0);
+				}
+				else if (native >= 0) {
+					pushFrame(FRAME_CALL, parser.previous.type, TYPE_UNKNOWN, precedence);
+					parser.frames[parser.frameCount - 1].native = native;
+					precedence = PREC_ASSIGNMENT;
+					continue;
+				}
+			}
+			else {
+				//ִ"token"ǰ׺֣emitһֽ
+				prefixRule->prefix();
+			}
+
+			for (;;) {
+				//"token "Ҳǵǰtokenprecedence͵ǰprecedenceȽ
+				//ǰtokenprecedence ڵڣwhile
+				ParseRule* infixRule = getRule(parser.current.type);
+				if (operand && infixRule->infixKind == RULE_BINARY &&
+					precedence <= infixRule->precedence) {
+					advance();
+					Scanner::TokenType operatorType = parser.previous.type;
+					pushFrame(FRAME_BINARY, operatorType, parser.lastType, precedence);
+					precedence = (Precedence)(getRule(operatorType)->precedence + 1);
+					break;
+				}
+
+				// This level is done: finish the construct that opened it
+				// and carry on with the enclosing level's infix loop.
+				if (parser.frameCount == base) return;
+				ParseFrame frame = parser.frames[--parser.frameCount];
+				bool nextOperand = false;
+				switch (frame.kind) {
+					case FRAME_BINARY:
+						emitBinary(frame.operatorType, frame.leftType);
+						break;
+					case FRAME_UNARY:
+						emitUnary(frame.operatorType);
+						break;
+					case FRAME_GROUPING:
+						consume(Scanner::TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+						break;
+					case FRAME_ARRAY:
+					case FRAME_CALL:
+						if (frame.kind == FRAME_ARRAY && frame.count == UINT8_MAX) {
+							error("Can't have more than 255 elements in an array literal.");
+						}
+						frame.count++;
+						if (match(Scanner::TOKEN_COMMA)) {
+							// Come back to this frame after the next one.
+							parser.frames[parser.frameCount++] = frame;
+							precedence = PREC_ASSIGNMENT;
+							nextOperand = true;
+						}
+						else if (frame.kind == FRAME_ARRAY) {
+							finishArray(frame.count);
+						}
+						else {
+							finishCall(frame.native, frame.count);
+						}
+						break;
+				}
+				if (nextOperand) break;
+				precedence = frame.precedence;
+				operand = true;
+			}
 		}
 	}
 
@@ -20,18 +20,73 @@ namespace Compiler {
         PREC_PRIMARY
     } Precedence;
     
+    // Static type lattice for expression results. TYPE_UNKNOWN is the top:
+    // the value may have any type at runtime.
+    typedef enum {
+        TYPE_UNKNOWN,
+        TYPE_NUMBER,
+        TYPE_BOOL,
+        TYPE_NIL
+    } StaticType;
+
+    // Work left pending while parsePrecedence() descends into an operand:
+    // the operator to emit or the ')' to consume once the operand is done,
+    // or the array literal or call whose next element or argument it is.
+    typedef enum {
+        FRAME_BINARY,
+        FRAME_UNARY,
+        FRAME_GROUPING,
+        FRAME_ARRAY,
+        FRAME_CALL
+    } FrameKind;
+
+    typedef struct {
+        FrameKind kind;
+        Scanner::TokenType operatorType;
+        StaticType leftType;
+        // Precedence of the level to resume afterwards.
+        Precedence precedence;
+        // FRAME_ARRAY and FRAME_CALL: elements or arguments already compiled.
+        int count;
+        // FRAME_CALL: index of the built-in being called.
+        int native;
+    } ParseFrame;
+
     typedef struct {
         Scanner::Token current;
         Scanner::Token previous;
+        const char* source;
+        Scanner::TokenBuffer tokens;
+        int nextToken;
+        // Type of the expression compiled last.
+        StaticType lastType;
+        // Explicit stack used by parsePrecedence() instead of recursion.
+        int frameCount;
+        int frameCapacity;
+        ParseFrame* frames;
         bool hadError;
         bool panicMode;
     } Parser;
 
     typedef void (*ParseFn)();
 
+    // How parsePrecedence() handles a token. A leaf rule is a plain
+    // function; the others open a frame for their operands.
+    typedef enum {
+        RULE_NONE,
+        RULE_LEAF,
+        RULE_GROUPING,
+        RULE_UNARY,
+        RULE_ARRAY,
+        RULE_CALL,
+        RULE_BINARY
+    } RuleKind;
+
     typedef struct {
+        RuleKind prefixKind;
+        // RULE_LEAF only.
         ParseFn prefix;
-        ParseFn infix;
+        RuleKind infixKind;
         Precedence precedence;
     } ParseRule;
 
@@ -41,12 +96,19 @@ namespace Compiler {
     static void error(const char* message);
     static void errorAt(Scanner::Token* token, const char* message);
     static void consume(Scanner::TokenType type, const char* message);
+    static bool match(Scanner::TokenType type);
     static void emitByte(uint8_t byte);
     static void emitBytes(uint8_t byte1, uint8_t byte2);
     static void endCompiler();
     static void number();
-    static void unary();
+    static void finishArray(int count);
+    static int findNative();
+    static void finishCall(int native, int argCount);
     static void parsePrecedence(Precedence precedence);
+    static void emitBinary(Scanner::TokenType operatorType, StaticType leftType);
+    static void emitUnary(Scanner::TokenType operatorType);
+    static void pushFrame(FrameKind kind, Scanner::TokenType operatorType,
+        StaticType leftType, Precedence precedence);
     static ParseRule* getRule(Scanner::TokenType type);
     static void expression();
     static void emitReturn();
@@ -12,49 +12,99 @@ void disassembleChunk(Chunk* chunk, const char* name)
 	printf("== end ==\n");
 }
 
-int disassembleInstruction(Chunk* chunk, int offset)
+int disassembleInstruction(Chunk* chunk, int offset, FILE* out)
 {
-	printf("%04d ", offset);
+	fprintf(out, "%04d ", offset);
 	if (offset > 0 &&
 		chunk->lines[offset] == chunk->lines[offset - 1]) {
-		printf("   | ");
+		fputs("   | ", out);
 	}
 	else {
-		printf("%4d ", chunk->lines[offset]);
+		fprintf(out, "%4d ", chunk->lines[offset]);
 	}
 	uint8_t instruction = chunk->code[offset];
 	switch (instruction) {
 		case OP_CONSTANT:
-			return constantInstruction("OP_CONSTANT", chunk, offset);
+			return constantInstruction("OP_CONSTANT", chunk, offset, out);
 		case OP_ADD:
-			return simpleInstruction("OP_ADD", offset);
+			return simpleInstruction("OP_ADD", offset, out);
 		case OP_SUBTRACT:
-			return simpleInstruction("OP_SUBTRACT", offset);
+			return simpleInstruction("OP_SUBTRACT", offset, out);
 		case OP_MULTIPLY:
-			return simpleInstruction("OP_MULTIPLY", offset);
+			return simpleInstruction("OP_MULTIPLY", offset, out);
 		case OP_DIVIDE:
-			return simpleInstruction("OP_DIVIDE", offset);
+			return simpleInstruction("OP_DIVIDE", offset, out);
 		case OP_NEGATE:
-			return simpleInstruction("OP_NEGATE", offset);
+			return simpleInstruction("OP_NEGATE", offset, out);
+		case OP_ADD_NN:
+			return simpleInstruction("OP_ADD_NN", offset, out);
+		case OP_SUBTRACT_NN:
+			return simpleInstruction("OP_SUBTRACT_NN", offset, out);
+		case OP_MULTIPLY_NN:
+			return simpleInstruction("OP_MULTIPLY_NN", offset, out);
+		case OP_DIVIDE_NN:
+			return simpleInstruction("OP_DIVIDE_NN", offset, out);
+		case OP_NEGATE_N:
+			return simpleInstruction("OP_NEGATE_N", offset, out);
+		case OP_ARRAY:
+			return byteInstruction("OP_ARRAY", chunk, offset, out);
+		case OP_SUM:
+			return simpleInstruction("OP_SUM", offset, out);
+		case OP_MIN:
+			return simpleInstruction("OP_MIN", offset, out);
+		case OP_MAX:
+			return simpleInstruction("OP_MAX", offset, out);
+		case OP_DOT:
+			return simpleInstruction("OP_DOT", offset, out);
 		case OP_RETURN:
-			return simpleInstruction("OP_RETURN", offset);
+			return simpleInstruction("OP_RETURN", offset, out);
 		default:
-			printf("Unknown opcode %d\n", instruction);
+			fprintf(out, "Unknown opcode %d\n", instruction);
 			return offset + 1;
 	}
 }
 
-static int simpleInstruction(const char* name, int offset) {
-	printf("%s\n", name);
+const char* opcodeName(uint8_t opcode)
+{
+	switch (opcode) {
+		case OP_CONSTANT:    return "OP_CONSTANT";
+		case OP_ADD:         return "OP_ADD";
+		case OP_SUBTRACT:    return "OP_SUBTRACT";
+		case OP_MULTIPLY:    return "OP_MULTIPLY";
+		case OP_DIVIDE:      return "OP_DIVIDE";
+		case OP_NEGATE:      return "OP_NEGATE";
+		case OP_ADD_NN:      return "OP_ADD_NN";
+		case OP_SUBTRACT_NN: return "OP_SUBTRACT_NN";
+		case OP_MULTIPLY_NN: return "OP_MULTIPLY_NN";
+		case OP_DIVIDE_NN:   return "OP_DIVIDE_NN";
+		case OP_NEGATE_N:    return "OP_NEGATE_N";
+		case OP_ARRAY:       return "OP_ARRAY";
+		case OP_SUM:         return "OP_SUM";
+		case OP_MIN:         return "OP_MIN";
+		case OP_MAX:         return "OP_MAX";
+		case OP_DOT:         return "OP_DOT";
+		case OP_RETURN:      return "OP_RETURN";
+		default:             return "OP_UNKNOWN";
+	}
+}
+
+static int simpleInstruction(const char* name, int offset, FILE* out) {
+	fprintf(out, "%s\n", name);
 	//OP_RETURNֻһֽ
 	return offset + 1;
 }
 
-static int constantInstruction(const char* name, Chunk* chunk, int offset) {
+static int byteInstruction(const char* name, Chunk* chunk, int offset, FILE* out) {
+	uint8_t operand = chunk->code[offset + 1];
+	fprintf(out, "%-16s %4d\n", name, operand);
+	return offset + 2;
+}
+
+static int constantInstruction(const char* name, Chunk* chunk, int offset, FILE* out) {
 	uint8_t constant = chunk->code[offset + 1];
-	printf("%-16s %4d '", name, constant);
-	printValue(chunk->constants.values[constant]);
-	printf("'\n");
+	fprintf(out, "%-16s %4d '", name, constant);
+	printValue(chunk->constants.values[constant], out);
+	fputs("'\n", out);
 	//OP_CONSTANTֽڡһǲ룬һǲ
 	return offset + 2;
 }
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <stdio.h>
+
 #include "chunk.h"
 
 void disassembleChunk(Chunk* chunk, const char* name);
-int disassembleInstruction(Chunk* chunk, int offset);
-static int simpleInstruction(const char* name, int offset);
-static int constantInstruction(const char* name, Chunk* chunk, int offset);
+int disassembleInstruction(Chunk* chunk, int offset, FILE* out = stdout);
+const char* opcodeName(uint8_t opcode);
+static int simpleInstruction(const char* name, int offset, FILE* out);
+static int byteInstruction(const char* name, Chunk* chunk, int offset, FILE* out);
+static int constantInstruction(const char* name, Chunk* chunk, int offset, FILE* out);
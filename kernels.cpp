@@ -0,0 +1,278 @@
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(KERNELS_X86) && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define KERNELS_SSE2
+#endif
+
+#if defined(KERNELS_X86) && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define KERNELS_AVX2
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// Broadcast operands are read through a small buffer of copies, so each
+// kernel loads every operand the same way and just does not advance it.
+#define SPLAT_WIDTH 4
+
+typedef void (*ArithmeticKernel)(const double* a, int aStep,
+    const double* b, int bStep, double* out, int count);
+
+#define SCALAR_KERNEL(name, op) \
+    static void name##Scalar(const double* a, int aStep, \
+        const double* b, int bStep, double* out, int count) { \
+        for (int i = 0; i < count; i++) { \
+            out[i] = a[i * aStep] op b[i * bStep]; \
+        } \
+    }
+
+SCALAR_KERNEL(add, +)
+SCALAR_KERNEL(subtract, -)
+SCALAR_KERNEL(multiply, *)
+SCALAR_KERNEL(divide, /)
+
+#ifdef KERNELS_SSE2
+#define SSE2_KERNEL(name, op, intrinsic) \
+    static void name##Sse2(const double* a, int aStep, \
+        const double* b, int bStep, double* out, int count) { \
+        int i = 0; \
+        for (; i + 2 <= count; i += 2) { \
+            __m128d va = _mm_loadu_pd(a + i * aStep); \
+            __m128d vb = _mm_loadu_pd(b + i * bStep); \
+            _mm_storeu_pd(out + i, intrinsic(va, vb)); \
+        } \
+        for (; i < count; i++) out[i] = a[i * aStep] op b[i * bStep]; \
+    }
+
+SSE2_KERNEL(add, +, _mm_add_pd)
+SSE2_KERNEL(subtract, -, _mm_sub_pd)
+SSE2_KERNEL(multiply, *, _mm_mul_pd)
+SSE2_KERNEL(divide, /, _mm_div_pd)
+#endif
+
+#ifdef KERNELS_AVX2
+#define AVX2_KERNEL(name, op, intrinsic) \
+    TARGET_AVX2 static void name##Avx2(const double* a, int aStep, \
+        const double* b, int bStep, double* out, int count) { \
+        int i = 0; \
+        for (; i + 4 <= count; i += 4) { \
+            __m256d va = _mm256_loadu_pd(a + i * aStep); \
+            __m256d vb = _mm256_loadu_pd(b + i * bStep); \
+            _mm256_storeu_pd(out + i, intrinsic(va, vb)); \
+        } \
+        for (; i < count; i++) out[i] = a[i * aStep] op b[i * bStep]; \
+    }
+
+AVX2_KERNEL(add, +, _mm256_add_pd)
+AVX2_KERNEL(subtract, -, _mm256_sub_pd)
+AVX2_KERNEL(multiply, *, _mm256_mul_pd)
+AVX2_KERNEL(divide, /, _mm256_div_pd)
+
+static bool cpuHasAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuidex(info, 7, 0);
+    if ((info[1] & (1 << 5)) == 0) return false;
+    // The OS must also save the YMM registers.
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0) return false;
+    return (_xgetbv(0) & 6) == 6;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+typedef struct {
+    ArithmeticKernel arithmetic[4];
+    bool avx2;
+    bool sse2;
+} KernelTable;
+
+static KernelTable selectKernels() {
+    KernelTable table = {
+        {addScalar, subtractScalar, multiplyScalar, divideScalar},
+        false, false,
+    };
+#ifdef KERNELS_SSE2
+    table = {{addSse2, subtractSse2, multiplySse2, divideSse2}, false, true};
+#endif
+#ifdef KERNELS_AVX2
+    if (cpuHasAvx2()) {
+        table = {{addAvx2, subtractAvx2, multiplyAvx2, divideAvx2}, true, true};
+    }
+#endif
+    return table;
+}
+
+static const KernelTable kernels = selectKernels();
+
+void arrayArithmetic(ArrayOp op, const double* a, bool aIsArray,
+    const double* b, bool bIsArray, double* out, int count) {
+    double splatA[SPLAT_WIDTH];
+    double splatB[SPLAT_WIDTH];
+    if (!aIsArray) {
+        for (int i = 0; i < SPLAT_WIDTH; i++) splatA[i] = *a;
+        a = splatA;
+    }
+    if (!bIsArray) {
+        for (int i = 0; i < SPLAT_WIDTH; i++) splatB[i] = *b;
+        b = splatB;
+    }
+    kernels.arithmetic[op](a, aIsArray ? 1 : 0, b, bIsArray ? 1 : 0, out, count);
+}
+
+void arrayNegate(const double* a, double* out, int count) {
+    // Plain negation flips only the sign bit, which compilers vectorise.
+    for (int i = 0; i < count; i++) out[i] = -a[i];
+}
+
+#ifdef KERNELS_AVX2
+TARGET_AVX2 static double sumAvx2(const double* a, int count) {
+    __m256d acc = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) acc = _mm256_add_pd(acc, _mm256_loadu_pd(a + i));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < count; i++) sum += a[i];
+    return sum;
+}
+
+TARGET_AVX2 static double dotAvx2(const double* a, const double* b, int count) {
+    __m256d acc = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        acc = _mm256_add_pd(acc,
+            _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < count; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+// Every lane starts from a[0] and takes an element only when the ordered
+// compare holds, so a NaN is never taken and a leading NaN is kept: the
+// same as the scalar loop. _mm256_min_pd/_mm256_max_pd would not do.
+#define AVX2_EXTREME(name, predicate, compare) \
+    TARGET_AVX2 static double name##Avx2(const double* a, int count) { \
+        double result = a[0]; \
+        int i = 0; \
+        if (count >= 4) { \
+            __m256d acc = _mm256_set1_pd(a[0]); \
+            for (; i + 4 <= count; i += 4) { \
+                __m256d x = _mm256_loadu_pd(a + i); \
+                acc = _mm256_blendv_pd(acc, x, _mm256_cmp_pd(x, acc, predicate)); \
+            } \
+            double lanes[4]; \
+            _mm256_storeu_pd(lanes, acc); \
+            result = lanes[0]; \
+            for (int lane = 1; lane < 4; lane++) { \
+                if (lanes[lane] compare result) result = lanes[lane]; \
+            } \
+        } \
+        for (; i < count; i++) { \
+            if (a[i] compare result) result = a[i]; \
+        } \
+        return result; \
+    }
+
+AVX2_EXTREME(min, _CMP_LT_OQ, <)
+AVX2_EXTREME(max, _CMP_GT_OQ, >)
+#endif
+
+#ifdef KERNELS_SSE2
+static double sumSse2(const double* a, int count) {
+    __m128d acc = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 2 <= count; i += 2) acc = _mm_add_pd(acc, _mm_loadu_pd(a + i));
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    double sum = lanes[0] + lanes[1];
+    for (; i < count; i++) sum += a[i];
+    return sum;
+}
+
+static double dotSse2(const double* a, const double* b, int count) {
+    __m128d acc = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    double sum = lanes[0] + lanes[1];
+    for (; i < count; i++) sum += a[i] * b[i];
+    return sum;
+}
+#endif
+
+double arraySum(const double* a, int count) {
+#ifdef KERNELS_AVX2
+    if (kernels.avx2) return sumAvx2(a, count);
+#endif
+#ifdef KERNELS_SSE2
+    return sumSse2(a, count);
+#else
+    double sum = 0;
+    for (int i = 0; i < count; i++) sum += a[i];
+    return sum;
+#endif
+}
+
+double arrayDot(const double* a, const double* b, int count) {
+#ifdef KERNELS_AVX2
+    if (kernels.avx2) return dotAvx2(a, b, count);
+#endif
+#ifdef KERNELS_SSE2
+    return dotSse2(a, b, count);
+#else
+    double sum = 0;
+    for (int i = 0; i < count; i++) sum += a[i] * b[i];
+    return sum;
+#endif
+}
+
+/*
+* Both paths keep an element only when it compares strictly below (above)
+* the current result, so NaNs after the first element are skipped and a
+* NaN first element is the result. Between equal elements the vector path
+* may keep a different one, which only shows as -0 versus 0.
+*/
+double arrayMin(const double* a, int count) {
+#ifdef KERNELS_AVX2
+    if (kernels.avx2) return minAvx2(a, count);
+#endif
+    double result = a[0];
+    for (int i = 1; i < count; i++) {
+        if (a[i] < result) result = a[i];
+    }
+    return result;
+}
+
+double arrayMax(const double* a, int count) {
+#ifdef KERNELS_AVX2
+    if (kernels.avx2) return maxAvx2(a, count);
+#endif
+    double result = a[0];
+    for (int i = 1; i < count; i++) {
+        if (a[i] > result) result = a[i];
+    }
+    return result;
+}
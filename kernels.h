@@ -0,0 +1,27 @@
+#pragma once
+
+#include "common.h"
+
+typedef enum {
+    ARRAY_ADD,
+    ARRAY_SUBTRACT,
+    ARRAY_MULTIPLY,
+    ARRAY_DIVIDE,
+} ArrayOp;
+
+/*
+* Element-wise kernels over packed doubles. They use AVX2 when the CPU has
+* it, SSE2 on other x86 targets and plain loops elsewhere. A scalar operand
+* is passed as a pointer to one double with isArray false and is broadcast.
+*/
+void arrayArithmetic(ArrayOp op, const double* a, bool aIsArray,
+    const double* b, bool bIsArray, double* out, int count);
+void arrayNegate(const double* a, double* out, int count);
+
+// Reductions. The vector paths add in a different order than a left-to-
+// right loop, so sums may differ from one in the last bits.
+double arraySum(const double* a, int count);
+double arrayDot(const double* a, const double* b, int count);
+// count must be at least 1.
+double arrayMin(const double* a, int count);
+double arrayMax(const double* a, int count);
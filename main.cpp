@@ -1,7 +1,11 @@
 ﻿#include "common.h"
+#include "bench.h"
 #include "chunk.h"
+#include "codegen.h"
+#include "compiler.h"
 #include "debug.h"
 #include "vm.h"
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -58,20 +62,140 @@ static void runFile(const char* path) {
 
 	if (result == INTERPRET_COMPILE_ERROR) exit(65);
 	if (result == INTERPRET_RUNTIME_ERROR) exit(70);
+	if (result == INTERPRET_INTERRUPTED) exit(75);
 }
 
 
 
+/*
+* Time repeated runs of one compiled script. The script's own output still
+* goes to stdout; the report goes to stderr.
+*/
+static void benchFile(const char* iterationsArg, const char* path) {
+	char* end;
+	long iterations = strtol(iterationsArg, &end, 10);
+	if (*end != '\0' || iterations < 1 || iterations > 100000000) {
+		fprintf(stderr, "Invalid run count \"%s\".\n", iterationsArg);
+		exit(64);
+	}
+
+	char* source = readFile(path);
+	int exitCode = benchSource(source, (int)iterations);
+	free(source);
+	if (exitCode != 0) exit(exitCode);
+}
+
+#ifdef DEBUG_TRACE_RING
+/*
+* Best effort: dump the trace ring and die with the original signal.
+*/
+static void crashHandler(int signal) {
+	fprintf(stderr, "Fatal signal %d.\n", signal);
+	dumpTrace();
+	::signal(signal, SIG_DFL);
+	raise(signal);
+}
+
+static void installCrashHandler() {
+#ifdef _WIN32
+	signal(SIGSEGV, crashHandler);
+	signal(SIGABRT, crashHandler);
+	signal(SIGFPE, crashHandler);
+#else
+	// The handler runs on its own stack, so a SIGSEGV from a C stack
+	// overflow is reported too.
+	static char alternateStack[1 << 16];
+	stack_t stack = {};
+	stack.ss_sp = alternateStack;
+	stack.ss_size = sizeof(alternateStack);
+	sigaltstack(&stack, NULL);
+
+	struct sigaction action = {};
+	action.sa_handler = crashHandler;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_ONSTACK;
+	sigaction(SIGSEGV, &action, NULL);
+	sigaction(SIGABRT, &action, NULL);
+	sigaction(SIGFPE, &action, NULL);
+#endif
+}
+#endif
+/*
+* Compile a script and write it out as a standalone C++ program instead of
+* running it.
+*/
+static void emitFile(const char* path, const char* outputPath) {
+	char* source = readFile(path);
+	Chunk chunk;
+	initChunk(&chunk);
+	if (!Compiler::compile(source, &chunk)) {
+		freeChunk(&chunk);
+		free(source);
+		exit(65);
+	}
+
+	FILE* output = nullptr;
+	if (fopen_s(&output, outputPath, "w") != 0 || output == NULL) {
+		fprintf(stderr, "Could not open file \"%s\".\n", outputPath);
+		exit(74);
+	}
+	bool emitted = emitCpp(&chunk, path, output);
+	fclose(output);
+	freeChunk(&chunk);
+	free(source);
+
+	if (!emitted) {
+		// Don't leave a truncated program behind.
+		remove(outputPath);
+		fprintf(stderr, "Could not translate \"%s\" to C++.\n", path);
+		exit(70);
+	}
+}
+
+/*
+* Leading diagnostic switches, usable with any mode. They select which
+* specialised interpreter loop runs, so none of them needs a rebuild.
+* Returns false if arg is not one of them.
+*/
+static bool parseDiagnostic(const char* arg, uint32_t* diagnostics) {
+	if (strcmp(arg, "--trace") == 0) *diagnostics |= DIAG_TRACE;
+	else if (strcmp(arg, "--checked") == 0) *diagnostics |= DIAG_CHECKED;
+	else if (strcmp(arg, "--profile") == 0) *diagnostics |= DIAG_PROFILE;
+	else if (strcmp(arg, "--print-code") == 0) *diagnostics |= DIAG_PRINT_CODE;
+	// The leanest loop: no trace ring to dump on an error.
+	else if (strcmp(arg, "--no-ring") == 0) *diagnostics &= ~DIAG_RING;
+	else return false;
+	return true;
+}
+
 int main(int argc, const char* argv[]) {
 	initVM();
+	uint32_t diagnostics = vm.diagnostics;
+	while (argc > 1 && parseDiagnostic(argv[1], &diagnostics)) {
+		argv++;
+		argc--;
+	}
+	setDiagnostics(diagnostics);
+#ifdef DEBUG_TRACE_RING
+	installCrashHandler();
+#endif
 	if (argc == 1) {
 		repl();
 	}
 	else if (argc == 2) {
 		runFile(argv[1]);
 	}
+	else if (argc == 4 && strcmp(argv[1], "--emit-cpp") == 0) {
+		emitFile(argv[2], argv[3]);
+	}
+	else if (argc == 4 && strcmp(argv[1], "--bench") == 0) {
+		benchFile(argv[2], argv[3]);
+	}
 	else {
-		fprintf(stderr, "Usage: clox [path]\n");
+		fprintf(stderr, "Usage: clox [options] [path]\n");
+		fprintf(stderr, "       clox [options] --emit-cpp <path> <output.cpp>\n");
+		fprintf(stderr, "       clox [options] --bench <runs> <path>\n");
+		fprintf(stderr, "Options: --trace --checked --profile --print-code --no-ring\n");
 		exit(64);
 	}
 	freeVM();
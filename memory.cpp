@@ -1,8 +1,141 @@
 #include "memory.h"
+#include "object.h"
+#include "vm.h"
 #include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#ifdef CLOX_POOL_ALLOCATOR
+#include <mutex>
+
+/*
+* Small blocks come from per-thread size-class pools. Each thread carves
+* blocks out of its current slab and recycles freed blocks on per-class
+* free lists, so there is no locking on the fast path. Slabs are never
+* handed back to the system; when a thread exits its cache is parked on
+* an orphan list for the next thread to adopt.
+*/
+#define POOL_GRANULE 16
+#define POOL_MAX_SIZE 256
+#define POOL_CLASSES (POOL_MAX_SIZE / POOL_GRANULE)
+#define POOL_SLAB_SIZE (64 * 1024)
+
+typedef struct FreeBlock {
+    struct FreeBlock* next;
+} FreeBlock;
+
+typedef struct PoolCache {
+    FreeBlock* freeLists[POOL_CLASSES];
+    uint8_t* slabCursor;
+    uint8_t* slabEnd;
+    struct PoolCache* nextOrphan;
+} PoolCache;
+
+static std::mutex orphanLock;
+static PoolCache* orphans = NULL;
+
+struct ThreadPool {
+    PoolCache* cache;
+
+    ThreadPool() {
+        std::lock_guard<std::mutex> guard(orphanLock);
+        if (orphans != NULL) {
+            cache = orphans;
+            orphans = orphans->nextOrphan;
+            return;
+        }
+        cache = (PoolCache*)calloc(1, sizeof(PoolCache));
+        if (cache == NULL) exit(1);
+    }
+
+    ~ThreadPool() {
+        std::lock_guard<std::mutex> guard(orphanLock);
+        cache->nextOrphan = orphans;
+        orphans = cache;
+    }
+};
+
+static thread_local ThreadPool threadPool;
+
+static inline int sizeClass(size_t size)
+{
+    return (int)((size - 1) / POOL_GRANULE);
+}
+
+static void* poolAllocate(size_t size)
+{
+    PoolCache* cache = threadPool.cache;
+    int index = sizeClass(size);
+    FreeBlock* block = cache->freeLists[index];
+    if (block != NULL) {
+        cache->freeLists[index] = block->next;
+        return block;
+    }
+
+    size_t blockSize = (size_t)(index + 1) * POOL_GRANULE;
+    if (cache->slabCursor == NULL ||
+        (size_t)(cache->slabEnd - cache->slabCursor) < blockSize) {
+        // The tail of the old slab is abandoned.
+        cache->slabCursor = (uint8_t*)malloc(POOL_SLAB_SIZE);
+        if (cache->slabCursor == NULL) exit(1);
+        cache->slabEnd = cache->slabCursor + POOL_SLAB_SIZE;
+    }
+    void* result = cache->slabCursor;
+    cache->slabCursor += blockSize;
+    return result;
+}
+
+static void poolFree(void* pointer, size_t size)
+{
+    PoolCache* cache = threadPool.cache;
+    int index = sizeClass(size);
+    FreeBlock* block = (FreeBlock*)pointer;
+    block->next = cache->freeLists[index];
+    cache->freeLists[index] = block;
+}
+
+static void* poolReallocate(void* pointer, size_t oldSize, size_t newSize)
+{
+    bool oldPooled = pointer != NULL && oldSize <= POOL_MAX_SIZE;
+    bool newPooled = newSize <= POOL_MAX_SIZE;
+
+    if (newSize == 0) {
+        if (oldPooled) poolFree(pointer, oldSize);
+        else free(pointer);
+        return NULL;
+    }
+
+    if (oldPooled && newPooled && sizeClass(oldSize) == sizeClass(newSize)) {
+        return pointer;
+    }
+
+    void* result;
+    if (newPooled) {
+        result = poolAllocate(newSize);
+    }
+    else {
+        result = malloc(newSize);
+        if (result == NULL) exit(1);
+    }
+
+    if (pointer != NULL) {
+        memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+        if (oldPooled) poolFree(pointer, oldSize);
+        else free(pointer);
+    }
+    return result;
+}
+#endif
 
 void* reallocate(void* pointer, size_t oldSize, size_t newSize)
 {
+#ifdef CLOX_POOL_ALLOCATOR
+    // Large buffers that stay large go straight to realloc below.
+    if (oldSize <= POOL_MAX_SIZE || newSize <= POOL_MAX_SIZE) {
+        return poolReallocate(pointer, oldSize, newSize);
+    }
+#endif
+
     if (newSize == 0) {
         free(pointer);
         return NULL;
@@ -12,3 +145,66 @@ void* reallocate(void* pointer, size_t oldSize, size_t newSize)
     if (result == NULL) exit(1);
     return result;
 }
+
+/*
+* Blocks aligned to CACHE_LINE_SIZE, for data the interpreter reads on
+* every instruction.
+*/
+void* allocateAligned(size_t size)
+{
+    void* result = ::operator new(size, std::align_val_t(CACHE_LINE_SIZE),
+        std::nothrow);
+    if (result == NULL) exit(1);
+    return result;
+}
+
+void freeAligned(void* pointer)
+{
+    ::operator delete(pointer, std::align_val_t(CACHE_LINE_SIZE));
+}
+
+static void freeObject(Obj* object)
+{
+    switch (object->type) {
+        case OBJ_STRING: {
+            ObjString* string = (ObjString*)object;
+            reallocate(object, sizeof(ObjString) + string->length + 1, 0);
+            break;
+        }
+        case OBJ_ARRAY: {
+            freeAligned(((ObjArray*)object)->values);
+            reallocate(object, sizeof(ObjArray), 0);
+            break;
+        }
+    }
+}
+
+void freeObjectList(Obj* objects)
+{
+    Obj* object = objects;
+    while (object != NULL) {
+        Obj* next = object->next;
+        freeObject(object);
+        object = next;
+    }
+}
+
+void freeObjects()
+{
+    freeObjectList(vm.objects);
+    vm.objects = NULL;
+}
+
+void freeObjectsSince(Obj* mark)
+{
+    Obj* object = vm.objects;
+    while (object != mark) {
+        Obj* next = object->next;
+        if (object->type == OBJ_STRING) {
+            tableDelete(&vm.strings, (ObjString*)object);
+        }
+        freeObject(object);
+        object = next;
+    }
+    vm.objects = mark;
+}
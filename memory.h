@@ -12,4 +12,13 @@
 #define FREE_ARRAY(type, pointer, oldCount) \
     reallocate(pointer, sizeof(type) * (oldCount), 0)
 
-void* reallocate(void* pointer, size_t oldSize, size_t newSize);
\ No newline at end of file
+#define CACHE_LINE_SIZE 64
+
+void* reallocate(void* pointer, size_t oldSize, size_t newSize);
+void* allocateAligned(size_t size);
+void freeAligned(void* pointer);
+void freeObjectList(struct Obj* objects);
+void freeObjects();
+// Free the objects made since vm.objects was mark, unlinking their strings
+// from the intern table. Nothing may still refer to them.
+void freeObjectsSince(struct Obj* mark);
\ No newline at end of file
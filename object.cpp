@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "memory.h"
+#include "object.h"
+#include "table.h"
+#include "vm.h"
+
+static ObjString* allocateString(int length) {
+    size_t size = sizeof(ObjString) + length + 1;
+    ObjString* string = (ObjString*)reallocate(NULL, 0, size);
+    string->obj.type = OBJ_STRING;
+    string->length = length;
+    string->chars = (char*)(string + 1);
+    return string;
+}
+
+static void freeString(ObjString* string) {
+    reallocate(string, sizeof(ObjString) + string->length + 1, 0);
+}
+
+// Objects made while a task runs belong to it and are freed with it.
+static void linkObject(Obj* object) {
+    Obj** objects = vm.task != NULL ? &vm.task->objects : &vm.objects;
+    object->next = *objects;
+    *objects = object;
+}
+
+// A task sees the VM's strings as well as its own.
+static ObjString* findString(const char* chars, int length, uint32_t hash) {
+    ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+    if (interned == NULL && vm.task != NULL) {
+        interned = tableFindString(&vm.task->strings, chars, length, hash);
+    }
+    return interned;
+}
+
+/*
+* Link a freshly built string into the VM, or hand back the existing copy
+* if one with the same contents is already interned.
+*/
+static ObjString* internString(ObjString* string) {
+    ObjString* interned = findString(string->chars, string->length,
+        string->hash);
+    if (interned != NULL) {
+        freeString(string);
+        return interned;
+    }
+
+    linkObject((Obj*)string);
+    tableSet(vm.task != NULL ? &vm.task->strings : &vm.strings, string,
+        NIL_VAL);
+    return string;
+}
+
+/*
+* FNV-1a. Passing a previous hash as the seed continues it, so the hash of
+* a concatenation can be built from the hash of its left operand.
+*/
+uint32_t hashString(const char* key, int length, uint32_t hash) {
+    for (int i = 0; i < length; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+ObjString* copyString(const char* chars, int length) {
+    uint32_t hash = hashString(chars, length);
+    ObjString* interned = findString(chars, length, hash);
+    if (interned != NULL) return interned;
+
+    ObjString* string = allocateString(length);
+    memcpy(string->chars, chars, length);
+    string->chars[length] = '\0';
+    string->hash = hash;
+    return internString(string);
+}
+
+/*
+* Both operands are copied straight into the result's own storage; there
+* is no intermediate buffer.
+*/
+ObjString* concatenateStrings(ObjString* a, ObjString* b) {
+    ObjString* result = allocateString(a->length + b->length);
+    memcpy(result->chars, a->chars, a->length);
+    memcpy(result->chars + a->length, b->chars, b->length);
+    result->chars[result->length] = '\0';
+    result->hash = hashString(b->chars, b->length, a->hash);
+    return internString(result);
+}
+
+// The elements are left uninitialised for the caller to fill in.
+ObjArray* newArray(int count) {
+    ObjArray* array = (ObjArray*)reallocate(NULL, 0, sizeof(ObjArray));
+    array->obj.type = OBJ_ARRAY;
+    array->count = count;
+    array->values = (double*)allocateAligned(sizeof(double) * count);
+    linkObject((Obj*)array);
+    return array;
+}
+
+static void printArray(ObjArray* array, FILE* out) {
+    fputs("[", out);
+    for (int i = 0; i < array->count; i++) {
+        if (i > 0) fputs(", ", out);
+        fprintf(out, "%g", array->values[i]);
+    }
+    fputs("]", out);
+}
+
+void printObject(Value value, FILE* out) {
+    switch (OBJ_TYPE(value)) {
+        case OBJ_STRING:
+            fputs(AS_CSTRING(value), out);
+            break;
+        case OBJ_ARRAY:
+            printArray(AS_ARRAY(value), out);
+            break;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "common.h"
+#include "value.h"
+
+#define OBJ_TYPE(value)   (AS_OBJ(value)->type)
+
+#define IS_STRING(value)  isObjType(value, OBJ_STRING)
+#define IS_ARRAY(value)   isObjType(value, OBJ_ARRAY)
+
+#define AS_STRING(value)  ((ObjString*)AS_OBJ(value))
+#define AS_CSTRING(value) (((ObjString*)AS_OBJ(value))->chars)
+#define AS_ARRAY(value)   ((ObjArray*)AS_OBJ(value))
+
+typedef enum {
+    OBJ_STRING,
+    OBJ_ARRAY,
+} ObjType;
+
+struct Obj {
+    ObjType type;
+    struct Obj* next;
+};
+
+/*
+* Strings are interned in vm.strings, so two strings with the same contents
+* are the same object. The characters live in the same allocation, right
+* after the header, and the hash is computed once when the string is made.
+*/
+struct ObjString {
+    Obj obj;
+    int length;
+    uint32_t hash;
+    char* chars;
+};
+
+/*
+* A fixed-length array of doubles. The elements are unboxed and kept in a
+* separate cache-line-aligned block so the kernels in kernels.cpp can run
+* over them with vector loads.
+*/
+struct ObjArray {
+    Obj obj;
+    int count;
+    double* values;
+};
+
+uint32_t hashString(const char* key, int length, uint32_t hash = 2166136261u);
+ObjString* copyString(const char* chars, int length);
+ObjString* concatenateStrings(ObjString* a, ObjString* b);
+ObjArray* newArray(int count);
+void printObject(Value value, FILE* out = stdout);
+
+static inline bool isObjType(Value value, ObjType type) {
+    return IS_OBJ(value) && AS_OBJ(value)->type == type;
+}
@@ -1,9 +1,15 @@
 #include <stdio.h>
 #include <string.h>
+#include <array>
+#include <string_view>
+#include <thread>
 
 #include "common.h"
+#include "memory.h"
 #include "scanner.h"
 
+#define MAX_SCAN_SEGMENTS 16
+
 namespace Scanner {
 	typedef struct {
 		const char* start;
@@ -11,7 +17,109 @@ namespace Scanner {
 		int line;
 	} Scanner;
 
-	Scanner scanner;
+	// Thread-local so that scanAll() can lex several segments at once.
+	thread_local Scanner scanner;
+
+	enum : uint8_t {
+		CHAR_ALPHA = 1 << 0,
+		CHAR_DIGIT = 1 << 1,
+	};
+
+	static constexpr std::array<uint8_t, 256> makeCharClasses() {
+		std::array<uint8_t, 256> classes{};
+		for (int c = 'a'; c <= 'z'; c++) classes[c] |= CHAR_ALPHA;
+		for (int c = 'A'; c <= 'Z'; c++) classes[c] |= CHAR_ALPHA;
+		classes['_'] |= CHAR_ALPHA;
+		for (int c = '0'; c <= '9'; c++) classes[c] |= CHAR_DIGIT;
+		return classes;
+	}
+
+	static constexpr std::array<uint8_t, 256> charClasses = makeCharClasses();
+
+	typedef struct {
+		std::string_view name;
+		TokenType type;
+	} Keyword;
+
+	// The reserved words. The perfect hash below is derived from this list
+	// at compile time, so adding a keyword needs no other change.
+	static constexpr Keyword keywords[] = {
+		{"and",    TOKEN_AND},
+		{"class",  TOKEN_CLASS},
+		{"else",   TOKEN_ELSE},
+		{"false",  TOKEN_FALSE},
+		{"for",    TOKEN_FOR},
+		{"fun",    TOKEN_FUN},
+		{"if",     TOKEN_IF},
+		{"nil",    TOKEN_NIL},
+		{"or",     TOKEN_OR},
+		{"print",  TOKEN_PRINT},
+		{"return", TOKEN_RETURN},
+		{"super",  TOKEN_SUPER},
+		{"this",   TOKEN_THIS},
+		{"true",   TOKEN_TRUE},
+		{"var",    TOKEN_VAR},
+		{"while",  TOKEN_WHILE},
+	};
+
+	#define KEYWORD_COUNT (sizeof(keywords) / sizeof(keywords[0]))
+	#define KEYWORD_SLOT_BITS 6
+	#define KEYWORD_SLOTS (1 << KEYWORD_SLOT_BITS)
+
+	static_assert(KEYWORD_COUNT < KEYWORD_SLOTS, "too many keywords");
+
+	/*
+	* Multiplicative hash of first character, last character and length,
+	* keeping the top KEYWORD_SLOT_BITS bits.
+	*/
+	static constexpr uint32_t keywordHash(uint32_t seed, char first, char last,
+		size_t length) {
+		uint32_t key = (uint32_t)(uint8_t)first |
+			((uint32_t)(uint8_t)last << 8) | ((uint32_t)length << 16);
+		return (key * seed) >> (32 - KEYWORD_SLOT_BITS);
+	}
+
+	// The first odd multiplier, counting up from the golden ratio, under
+	// which no two keywords collide.
+	static constexpr uint32_t findKeywordSeed() {
+		for (uint32_t i = 0; i < (1u << 16); i++) {
+			uint32_t seed = 0x9E3779B1u + 2 * i;
+			bool used[KEYWORD_SLOTS] = {};
+			bool collision = false;
+			for (const Keyword& keyword : keywords) {
+				uint32_t slot = keywordHash(seed, keyword.name.front(),
+					keyword.name.back(), keyword.name.size());
+				if (used[slot]) {
+					collision = true;
+					break;
+				}
+				used[slot] = true;
+			}
+			if (!collision) return seed;
+		}
+		return 0;
+	}
+
+	static constexpr uint32_t keywordSeed = findKeywordSeed();
+	static_assert(keywordSeed != 0, "no perfect hash for the keyword list");
+
+	// Slot -> index into keywords[] plus one; 0 for an empty slot.
+	static constexpr std::array<uint8_t, KEYWORD_SLOTS> makeKeywordSlots() {
+		std::array<uint8_t, KEYWORD_SLOTS> slots{};
+		for (size_t i = 0; i < KEYWORD_COUNT; i++) {
+			const Keyword& keyword = keywords[i];
+			slots[keywordHash(keywordSeed, keyword.name.front(),
+				keyword.name.back(), keyword.name.size())] = (uint8_t)(i + 1);
+		}
+		return slots;
+	}
+
+	static constexpr std::array<uint8_t, KEYWORD_SLOTS> keywordSlots =
+		makeKeywordSlots();
+
+	static inline uint32_t keywordSlot(char first, char last, size_t length) {
+		return keywordHash(keywordSeed, first, last, length);
+	}
 
 	void initScanner(const char* source) {
 		scanner.start = source;
@@ -32,6 +140,8 @@ namespace Scanner {
 		case ')': return makeToken(TOKEN_RIGHT_PAREN);
 		case '{': return makeToken(TOKEN_LEFT_BRACE);
 		case '}': return makeToken(TOKEN_RIGHT_BRACE);
+		case '[': return makeToken(TOKEN_LEFT_BRACKET);
+		case ']': return makeToken(TOKEN_RIGHT_BRACKET);
 		case ';': return makeToken(TOKEN_SEMICOLON);
 		case ',': return makeToken(TOKEN_COMMA);
 		case '.': return makeToken(TOKEN_DOT);
@@ -57,6 +167,208 @@ namespace Scanner {
 		return errorToken("Unexpected character.");
 	}
 
+	void initTokenBuffer(TokenBuffer* buffer) {
+		buffer->count = 0;
+		buffer->capacity = 0;
+		buffer->types = NULL;
+		buffer->offsets = NULL;
+		buffer->lengths = NULL;
+		buffer->lines = NULL;
+		buffer->errorCount = 0;
+		buffer->errorCapacity = 0;
+		buffer->errors = NULL;
+	}
+
+	void freeTokenBuffer(TokenBuffer* buffer) {
+		FREE_ARRAY(uint8_t, buffer->types, buffer->capacity);
+		FREE_ARRAY(int, buffer->offsets, buffer->capacity);
+		FREE_ARRAY(int, buffer->lengths, buffer->capacity);
+		FREE_ARRAY(int, buffer->lines, buffer->capacity);
+		FREE_ARRAY(const char*, buffer->errors, buffer->errorCapacity);
+		initTokenBuffer(buffer);
+	}
+
+	/*
+	* Tokenise the whole source up front. Large sources are cut at newlines
+	* outside strings and comments, each segment is lexed on its own thread
+	* with lines counted from 1, and the results are stitched together.
+	*/
+	void scanAll(const char* source, TokenBuffer* buffer) {
+		size_t length = strlen(source);
+		int segmentCount = 1;
+		if (length >= SCAN_PARALLEL_THRESHOLD) {
+			size_t bySize = length / (SCAN_PARALLEL_THRESHOLD / 4);
+			unsigned int cores = std::thread::hardware_concurrency();
+			segmentCount = (int)(bySize < cores ? bySize : cores);
+			if (segmentCount > MAX_SCAN_SEGMENTS) segmentCount = MAX_SCAN_SEGMENTS;
+		}
+
+		if (segmentCount <= 1) {
+			scanSegment(source, source, source + length, buffer);
+			return;
+		}
+
+		const char* starts[MAX_SCAN_SEGMENTS + 1];
+		int lines[MAX_SCAN_SEGMENTS];
+		segmentCount = splitSegments(source, length, segmentCount, starts, lines);
+		starts[segmentCount] = source + length;
+
+		TokenBuffer parts[MAX_SCAN_SEGMENTS];
+		std::thread workers[MAX_SCAN_SEGMENTS];
+		for (int i = 0; i < segmentCount; i++) initTokenBuffer(&parts[i]);
+		for (int i = 1; i < segmentCount; i++) {
+			workers[i] = std::thread(scanSegment, source, starts[i],
+				starts[i + 1], &parts[i]);
+		}
+		scanSegment(source, starts[0], starts[1], &parts[0]);
+		for (int i = 1; i < segmentCount; i++) workers[i].join();
+
+		// Size the result once, then copy each part's columns in bulk. Only
+		// the line numbers and the error indices need rebasing.
+		int tokenCount = buffer->count;
+		int errorCount = buffer->errorCount;
+		for (int i = 0; i < segmentCount; i++) {
+			tokenCount += parts[i].count;
+			errorCount += parts[i].errorCount;
+		}
+		reserveTokens(buffer, tokenCount, errorCount);
+
+		for (int i = 0; i < segmentCount; i++) {
+			TokenBuffer* part = &parts[i];
+			int base = buffer->count;
+			int lineBase = lines[i] - 1;
+			int errorBase = buffer->errorCount;
+			memcpy(buffer->types + base, part->types, sizeof(uint8_t) * part->count);
+			memcpy(buffer->offsets + base, part->offsets, sizeof(int) * part->count);
+			memcpy(buffer->lengths + base, part->lengths, sizeof(int) * part->count);
+			for (int t = 0; t < part->count; t++) {
+				buffer->lines[base + t] = part->lines[t] + lineBase;
+				if (part->types[t] == TOKEN_ERROR) buffer->offsets[base + t] += errorBase;
+			}
+			if (part->errorCount > 0) {
+				memcpy(buffer->errors + errorBase, part->errors,
+					sizeof(const char*) * part->errorCount);
+			}
+			buffer->count += part->count;
+			buffer->errorCount += part->errorCount;
+			freeTokenBuffer(part);
+		}
+	}
+
+	Token tokenAt(const char* source, const TokenBuffer* buffer, int index) {
+		Token token;
+		token.type = (TokenType)buffer->types[index];
+		token.length = buffer->lengths[index];
+		token.line = buffer->lines[index];
+		if (token.type == TOKEN_ERROR) {
+			token.start = buffer->errors[buffer->offsets[index]];
+		}
+		else {
+			token.start = source + buffer->offsets[index];
+		}
+		return token;
+	}
+
+	// Make room for at least tokenCount tokens and errorCount errors.
+	static void reserveTokens(TokenBuffer* buffer, int tokenCount,
+		int errorCount) {
+		if (buffer->capacity < tokenCount) {
+			int oldCapacity = buffer->capacity;
+			buffer->capacity = tokenCount;
+			buffer->types = GROW_ARRAY(uint8_t, buffer->types,
+				oldCapacity, buffer->capacity);
+			buffer->offsets = GROW_ARRAY(int, buffer->offsets,
+				oldCapacity, buffer->capacity);
+			buffer->lengths = GROW_ARRAY(int, buffer->lengths,
+				oldCapacity, buffer->capacity);
+			buffer->lines = GROW_ARRAY(int, buffer->lines,
+				oldCapacity, buffer->capacity);
+		}
+		if (buffer->errorCapacity < errorCount) {
+			int oldCapacity = buffer->errorCapacity;
+			buffer->errorCapacity = errorCount;
+			buffer->errors = GROW_ARRAY(const char*, buffer->errors,
+				oldCapacity, buffer->errorCapacity);
+		}
+	}
+
+	static void writeToken(TokenBuffer* buffer, const char* source,
+		Token token) {
+		if (buffer->capacity < buffer->count + 1) {
+			reserveTokens(buffer, GROW_CAPACITY(buffer->capacity),
+				buffer->errorCapacity);
+		}
+
+		int offset;
+		if (token.type == TOKEN_ERROR) {
+			if (buffer->errorCapacity < buffer->errorCount + 1) {
+				reserveTokens(buffer, buffer->capacity,
+					GROW_CAPACITY(buffer->errorCapacity));
+			}
+			offset = buffer->errorCount;
+			buffer->errors[buffer->errorCount++] = token.start;
+		}
+		else {
+			offset = (int)(token.start - source);
+		}
+
+		buffer->types[buffer->count] = (uint8_t)token.type;
+		buffer->offsets[buffer->count] = offset;
+		buffer->lengths[buffer->count] = token.length;
+		buffer->lines[buffer->count] = token.line;
+		buffer->count++;
+	}
+
+	static void scanSegment(const char* source, const char* start,
+		const char* end, TokenBuffer* buffer) {
+		initScanner(start);
+		for (;;) {
+			Token token = scanToken();
+			// Whitespace skipping may carry us into the next segment; the
+			// token found there belongs to that segment. Only the final
+			// segment ends at the terminator and keeps its TOKEN_EOF.
+			if (scanner.start >= end && *end != '\0') return;
+			writeToken(buffer, source, token);
+			if (token.type == TOKEN_EOF) return;
+		}
+	}
+
+	/*
+	* Pick up to segmentCount starting points, each just after a newline that
+	* is outside any string or comment, so no token straddles a boundary.
+	* Returns the number of segments found.
+	*/
+	static int splitSegments(const char* source, size_t length,
+		int segmentCount, const char** starts, int* lines) {
+		starts[0] = source;
+		lines[0] = 1;
+		int count = 1;
+		int line = 1;
+		bool inString = false;
+		size_t target = length / segmentCount;
+
+		for (size_t i = 0; i < length && count < segmentCount; i++) {
+			char c = source[i];
+			if (c == '\n') {
+				line++;
+				if (!inString && i >= target && i + 1 < length) {
+					starts[count] = source + i + 1;
+					lines[count] = line;
+					count++;
+					target = length / segmentCount * count;
+				}
+			}
+			else if (c == '"') {
+				inString = !inString;
+			}
+			else if (c == '/' && !inString && source[i + 1] == '/') {
+				// Stop just before the newline so it is counted above.
+				while (i + 1 < length && source[i + 1] != '\n') i++;
+			}
+		}
+		return count;
+	}
+
 	static Token errorToken(const char* message) {
 		Token token;
 		token.type = TOKEN_ERROR;
@@ -111,49 +423,20 @@ namespace Scanner {
 	}
 
 	static TokenType identifierType() {
-		switch (scanner.start[0]) {
-		case 'a': return checkKeyword(1, 2, "nd", TOKEN_AND);
-		case 'c': return checkKeyword(1, 4, "lass", TOKEN_CLASS);
-		case 'e': return checkKeyword(1, 3, "lse", TOKEN_ELSE);
-		case 'f':
-			if (scanner.current - scanner.start > 1) {
-				switch (scanner.start[1]) {
-				case 'a': return checkKeyword(2, 3, "lse", TOKEN_FALSE);
-				case 'o': return checkKeyword(2, 1, "r", TOKEN_FOR);
-				case 'u': return checkKeyword(2, 1, "n", TOKEN_FUN);
-				}
-			}
-			break;
-		case 'i': return checkKeyword(1, 1, "f", TOKEN_IF);
-		case 'n': return checkKeyword(1, 2, "il", TOKEN_NIL);
-		case 'o': return checkKeyword(1, 1, "r", TOKEN_OR);
-		case 'p': return checkKeyword(1, 4, "rint", TOKEN_PRINT);
-		case 'r': return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
-		case 's': return checkKeyword(1, 4, "uper", TOKEN_SUPER);
-		case 't':
-			if (scanner.current - scanner.start > 1) {
-				switch (scanner.start[1]) {
-				case 'h': return checkKeyword(2, 2, "is", TOKEN_THIS);
-				case 'r': return checkKeyword(2, 2, "ue", TOKEN_TRUE);
-				}
+		size_t length = (size_t)(scanner.current - scanner.start);
+		uint32_t slot = keywordSlot(scanner.start[0],
+			scanner.start[length - 1], length);
+		uint8_t index = keywordSlots[slot];
+		if (index != 0) {
+			const Keyword& keyword = keywords[index - 1];
+			if (keyword.name.size() == length &&
+				memcmp(scanner.start, keyword.name.data(), length) == 0) {
+				return keyword.type;
 			}
-			break;
-		case 'v': return checkKeyword(1, 2, "ar", TOKEN_VAR);
-		case 'w': return checkKeyword(1, 4, "hile", TOKEN_WHILE);
 		}
 		return TOKEN_IDENTIFIER;
 	}
 
-	static TokenType checkKeyword(int start, int length,
-		const char* rest, TokenType type) {
-		if (scanner.current - scanner.start == start + length &&
-			memcmp(scanner.start + start, rest, length) == 0) {
-			return type;
-		}
-
-		return TOKEN_IDENTIFIER;
-	}
-
 	static char peekNext() {
 		if (isAtEnd()) return '\0';
 		return scanner.current[1];
@@ -177,7 +460,7 @@ namespace Scanner {
 	}
 
 	static bool isDigit(char c) {
-		return c >= '0' && c <= '9';
+		return (charClasses[(uint8_t)c] & CHAR_DIGIT) != 0;
 	}
 
 	static Token number() {
@@ -195,14 +478,12 @@ namespace Scanner {
 	}
 
 	static Token identifier() {
-		while (isAlpha(peek()) || isDigit(peek())) advance();
+		while (charClasses[(uint8_t)peek()] & (CHAR_ALPHA | CHAR_DIGIT)) advance();
 		return makeToken(identifierType());
 	}
 
 	static bool isAlpha(char c) {
-		return (c >= 'a' && c <= 'z') ||
-			(c >= 'A' && c <= 'Z') ||
-			c == '_';
+		return (charClasses[(uint8_t)c] & CHAR_ALPHA) != 0;
 	}
 
 	static Token makeToken(TokenType type) {
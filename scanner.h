@@ -1,9 +1,12 @@
 #pragma once
+#include "common.h"
+
 namespace Scanner {
 	typedef enum {
 		// Single-character tokens. ַʷ
 		TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
 		TOKEN_LEFT_BRACE, TOKEN_RIGHT_BRACE,
+		TOKEN_LEFT_BRACKET, TOKEN_RIGHT_BRACKET,
 		TOKEN_COMMA, TOKEN_DOT, TOKEN_MINUS, TOKEN_PLUS,
 		TOKEN_SEMICOLON, TOKEN_SLASH, TOKEN_STAR,
 		// One or two character tokens. һַʷ
@@ -29,8 +32,31 @@ namespace Scanner {
 		int line;
 	} Token;
 
+	// Struct-of-arrays token stream filled by scanAll(). Lexemes are
+	// stored as offsets into the source; for TOKEN_ERROR the offset
+	// indexes errors[] instead, since the message is not in the source.
+	typedef struct {
+		int count;
+		int capacity;
+		uint8_t* types;
+		int* offsets;
+		int* lengths;
+		int* lines;
+		int errorCount;
+		int errorCapacity;
+		const char** errors;
+	} TokenBuffer;
+
+	// Sources at least this long are split into segments and lexed on
+	// several threads.
+	#define SCAN_PARALLEL_THRESHOLD (1 << 20)
+
 	void initScanner(const char* source);
 	Token scanToken();
+	void initTokenBuffer(TokenBuffer* buffer);
+	void freeTokenBuffer(TokenBuffer* buffer);
+	void scanAll(const char* source, TokenBuffer* buffer);
+	Token tokenAt(const char* source, const TokenBuffer* buffer, int index);
 	static Token errorToken(const char* message);
 	static void skipWhitespace();
 	static bool isAtEnd();
@@ -44,6 +70,13 @@ namespace Scanner {
 	static Token string();
 	static char peek();
 	static char peekNext();
-	static TokenType checkKeyword(int start, int length,
-		const char* rest, TokenType type);
+	static TokenType identifierType();
+	static void reserveTokens(TokenBuffer* buffer, int tokenCount,
+		int errorCount);
+	static void writeToken(TokenBuffer* buffer, const char* source,
+		Token token);
+	static void scanSegment(const char* source, const char* start,
+		const char* end, TokenBuffer* buffer);
+	static int splitSegments(const char* source, size_t length,
+		int segmentCount, const char** starts, int* lines);
 }
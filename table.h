@@ -0,0 +1,27 @@
+#pragma once
+
+#include "common.h"
+#include "value.h"
+
+typedef struct {
+    ObjString* key;
+    Value value;
+} Entry;
+
+/*
+* Open-addressing hash table with linear probing, keyed by interned
+* strings. Capacity is always a power of two.
+*/
+typedef struct {
+    int count;
+    int capacity;
+    Entry* entries;
+} Table;
+
+void initTable(Table* table);
+void freeTable(Table* table);
+bool tableGet(Table* table, ObjString* key, Value* value);
+bool tableSet(Table* table, ObjString* key, Value value);
+bool tableDelete(Table* table, ObjString* key);
+ObjString* tableFindString(Table* table, const char* chars, int length,
+    uint32_t hash);
@@ -1,5 +1,6 @@
 #include "value.h"
 #include "memory.h"
+#include "object.h"
 #include <stdio.h>
 
 void initValueArray(ValueArray* array)
@@ -22,12 +23,48 @@ void writeValueArray(ValueArray* array, Value value)
 	array->count++;
 }
 
+void reserveValueArray(ValueArray* array, int capacity)
+{
+	if (array->capacity < capacity) {
+		array->values = GROW_ARRAY(Value, array->values,
+			array->capacity, capacity);
+		array->capacity = capacity;
+	}
+}
+
 void freeValueArray(ValueArray* array)
 {
 	FREE_ARRAY(Value, array->values, array->capacity);
 	initValueArray(array);
 }
 
-void printValue(Value value) {
-	printf("%g", AS_NUMBER(value));
+void printValue(Value value, FILE* out) {
+	switch (value.type) {
+		case VAL_BOOL:
+			fputs(AS_BOOL(value) ? "true" : "false", out);
+			break;
+		case VAL_NIL: fputs("nil", out); break;
+		case VAL_NUMBER: fprintf(out, "%g", AS_NUMBER(value)); break;
+		// Printed through double so the output matches a VAL_NUMBER.
+		case VAL_INT: fprintf(out, "%g", (double)AS_INT(value)); break;
+		case VAL_OBJ: printObject(value, out); break;
+	}
+}
+
+/*
+* Strings are interned, so comparing object pointers is enough.
+*/
+bool valuesEqual(Value a, Value b) {
+	if (IS_NUMBER(a) && IS_NUMBER(b)) {
+		if (IS_INT(a) && IS_INT(b)) return AS_INT(a) == AS_INT(b);
+		return AS_NUMBER(a) == AS_NUMBER(b);
+	}
+	if (a.type != b.type) return false;
+	switch (a.type) {
+		case VAL_BOOL:   return AS_BOOL(a) == AS_BOOL(b);
+		case VAL_NIL:    return true;
+		case VAL_NUMBER: return AS_NUMBER(a) == AS_NUMBER(b);
+		case VAL_OBJ:    return AS_OBJ(a) == AS_OBJ(b);
+		default:         return false; // Unreachable.
+	}
 }
@@ -1,9 +1,16 @@
 #pragma once
+#include <stdio.h>
 #include "common.h"
+
+struct Obj;
+struct ObjString;
+
 typedef enum {
 	VAL_BOOL,
 	VAL_NIL,
 	VAL_NUMBER,
+	VAL_INT,
+	VAL_OBJ,
 } ValueType;
 
 struct  Value {
@@ -11,6 +18,8 @@ struct  Value {
 	union {
 		bool boolean;
 		double number;
+		int64_t integer;
+		Obj* obj;
 	} as;
 
 	// Value
@@ -27,6 +36,20 @@ struct  Value {
 	Value() : type(VAL_NIL) {
 		as.number = 0;
 	}
+
+	// Heap object Value
+	Value(Obj* object) : type(VAL_OBJ) {
+		as.obj = object;
+	}
+
+	// Integer Value. A named factory, since an int argument would be
+	// ambiguous between the double, bool and int64_t constructors.
+	static Value integer(int64_t i) {
+		Value value;
+		value.type = VAL_INT;
+		value.as.integer = i;
+		return value;
+	}
 };
 
 typedef struct {
@@ -37,16 +60,77 @@ typedef struct {
 
 #define IS_BOOL(value)    ((value).type == VAL_BOOL)
 #define IS_NIL(value)     ((value).type == VAL_NIL)
-#define IS_NUMBER(value)  ((value).type == VAL_NUMBER)
+// Integers are an internal representation of numbers: IS_NUMBER and
+// AS_NUMBER accept both, and no program can tell them apart.
+#define IS_NUMBER(value)  ((value).type == VAL_NUMBER || (value).type == VAL_INT)
+#define IS_INT(value)     ((value).type == VAL_INT)
+#define IS_OBJ(value)     ((value).type == VAL_OBJ)
 //
 #define AS_BOOL(value)    ((value).as.boolean)
-#define AS_NUMBER(value)  ((value).as.number)
+#define AS_NUMBER(value)  valueToNumber(value)
+#define AS_INT(value)     ((value).as.integer)
+#define AS_OBJ(value)     ((value).as.obj)
 //װ
 #define NUMBER_VAL(value) Value(value)
 #define BOOL_VAL(value) Value(value)
 #define NIL_VAL Value()
+#define OBJ_VAL(object) Value((Obj*)(object))
+#define INT_VAL(value) Value::integer(value)
+
+// Integers are kept only while every double could represent them exactly.
+#define MAX_SAFE_INT ((int64_t)1 << 53)
+
+static inline double valueToNumber(Value value) {
+	return value.type == VAL_INT ? (double)value.as.integer : value.as.number;
+}
+
+static inline bool isSafeInt(int64_t i) {
+	return i >= -MAX_SAFE_INT && i <= MAX_SAFE_INT;
+}
+
+/*
+* Integer arithmetic on safe integers. Each returns false when the exact
+* result would not be a safe integer, or when the double result would be
+* -0; the caller then redoes the operation in double precision.
+*/
+static inline bool addInts(int64_t a, int64_t b, int64_t* result) {
+	// Safe integers are at most 2^53, so the sum cannot overflow.
+	*result = a + b;
+	return isSafeInt(*result);
+}
+
+static inline bool subtractInts(int64_t a, int64_t b, int64_t* result) {
+	*result = a - b;
+	return isSafeInt(*result);
+}
+
+static inline bool multiplyInts(int64_t a, int64_t b, int64_t* result) {
+	// The double product is close enough to rule out int64 overflow.
+	double estimate = (double)a * (double)b;
+	if (estimate > 4.0 * MAX_SAFE_INT || estimate < -4.0 * MAX_SAFE_INT) {
+		return false;
+	}
+	*result = a * b;
+	if (*result == 0 && (a < 0 || b < 0)) return false;
+	return isSafeInt(*result);
+}
+
+static inline bool divideInts(int64_t a, int64_t b, int64_t* result) {
+	if (b == 0 || a % b != 0) return false;
+	*result = a / b;
+	if (*result == 0 && b < 0) return false;
+	return true;
+}
+
+static inline bool negateInt(int64_t a, int64_t* result) {
+	if (a == 0) return false;
+	*result = -a;
+	return true;
+}
 
 void initValueArray(ValueArray* array);
 void writeValueArray(ValueArray* array, Value value);
+void reserveValueArray(ValueArray* array, int capacity);
 void freeValueArray(ValueArray* array);
-void printValue(Value value);
+void printValue(Value value, FILE* out = stdout);
+bool valuesEqual(Value a, Value b);
@@ -2,16 +2,76 @@
 #include <stdio.h>
 #include "debug.h"
 #include "compiler.h"
+#include "kernels.h"
+#include "memory.h"
+#include "object.h"
 #include <stdarg.h>
+#include <string.h>
+#include <chrono>
+
+static_assert(std::atomic<bool>::is_always_lock_free,
+    "interruptVM() must be async-signal-safe");
 
 VM vm;
 void initVM()
 {
+    vm.stack = vm.stackSlots + 1;
+    vm.stack[-1] = NIL_VAL;
     resetStack();
+    vm.chunk = NULL;
+    vm.objects = NULL;
+    vm.task = NULL;
+    initTable(&vm.strings);
+    vm.instructionBudget = 0;
+    vm.timeLimitMillis = 0;
+    vm.interruptRequested.store(false);
+#ifdef DEBUG_TRACE_RING
+    vm.diagnostics = DIAG_RING;
+#else
+    vm.diagnostics = 0;
+#endif
+    memset(vm.profile, 0, sizeof(vm.profile));
+#ifdef DEBUG_TRACE_RING
+    vm.traceCount = 0;
+#endif
+}
+
+void setInstructionBudget(uint64_t instructions)
+{
+    vm.instructionBudget = instructions;
+}
+
+void setTimeLimit(uint64_t milliseconds)
+{
+    vm.timeLimitMillis = milliseconds;
+}
+
+void setDiagnostics(uint32_t diagnostics)
+{
+    vm.diagnostics = diagnostics;
+}
+
+/*
+* Ask the running interpreter to stop at its next preemption check. Safe to
+* call from another thread or from a signal handler. A request made while
+* nothing is running stops the next run; one the current run finishes
+* before noticing is dropped rather than left for an unrelated later run.
+*/
+void interruptVM()
+{
+    vm.interruptRequested.store(true, std::memory_order_relaxed);
+}
+
+static uint64_t monotonicMillis() {
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<milliseconds>(
+        steady_clock::now().time_since_epoch()).count();
 }
 
 void freeVM()
 {
+    freeTable(&vm.strings);
+    freeObjects();
 }
 
 static void resetStack() {
@@ -25,9 +85,14 @@ static void runtimeError(const char* format, ...) {
     va_end(args);
     fputs("\n", stderr);
 
-    size_t instruction = vm.ip - vm.chunk->code - 1;
+    // Nothing has run yet if the run was stopped before its first
+    // instruction; report the line of that instruction.
+    size_t instruction = vm.ip > vm.chunk->code ? vm.ip - vm.chunk->code - 1 : 0;
     int line = vm.chunk->lines[instruction];
     fprintf(stderr, "[line %d] in script\n", line);
+#ifdef DEBUG_TRACE_RING
+    dumpTrace();
+#endif
     resetStack();
 }
 
@@ -43,10 +108,6 @@ Value pop()
     return *vm.stackTop;
 }
 
-static Value peek(int distance) {
-    return vm.stackTop[-1 - distance];
-}
-
 InterpretResult interpret(const char* source)
 {
     Chunk chunk;
@@ -57,64 +118,509 @@ InterpretResult interpret(const char* source)
         return INTERPRET_COMPILE_ERROR;
     }
 
-    vm.chunk = &chunk;
+    InterpretResult result = interpretChunk(&chunk);
+    if (vm.diagnostics & DIAG_PROFILE) dumpProfile();
+
+    freeChunk(&chunk);
+    return result;
+}
+
+/*
+* Run an already compiled chunk from its first instruction. The caller
+* keeps ownership, so the same chunk can be run any number of times.
+*/
+InterpretResult interpretChunk(Chunk* chunk)
+{
+    vm.chunk = chunk;
     vm.ip = vm.chunk->code;
+#ifdef DEBUG_TRACE_RING
+    // Successive runs may put their chunks at the same address, so older
+    // records could not be told apart from this run's.
+    vm.traceCount = 0;
+#endif
+    vm.budgeted = vm.instructionBudget != 0;
+    vm.budgetLeft = vm.instructionBudget;
+    vm.deadline = vm.timeLimitMillis != 0
+        ? monotonicMillis() + vm.timeLimitMillis : 0;
+    vm.resumable = false;
 
-    InterpretResult result = run();
+    return runVariant();
+}
 
-    freeChunk(&chunk);
+/*
+* Compile source into a parked task. Returns NULL on a compile error.
+*/
+Task* newTask(const char* source)
+{
+    Task* task = (Task*)reallocate(NULL, 0, sizeof(Task));
+    initChunk(&task->chunk);
+    task->objects = NULL;
+    initTable(&task->strings);
+    // The chunk's string constants belong to the task too.
+    vm.task = task;
+    bool compiled = Compiler::compile(source, &task->chunk);
+    vm.task = NULL;
+    if (!compiled) {
+        freeTask(task);
+        return NULL;
+    }
+
+    task->ip = task->chunk.code;
+    task->stackCount = 0;
+    task->stackCapacity = 0;
+    task->stack = NULL;
+    task->status = INTERPRET_YIELDED;
+    return task;
+}
+
+/*
+* Run the task for at most the given number of instructions (0 runs it to
+* the end). Returns INTERPRET_YIELDED if it was parked again; any other
+* result is final and is returned again by later calls.
+*/
+InterpretResult resumeTask(Task* task, uint32_t instructions)
+{
+    if (task->status != INTERPRET_YIELDED) return task->status;
+
+    vm.chunk = &task->chunk;
+    vm.ip = task->ip;
+    if (task->stackCount > 0) {
+        memcpy(vm.stack, task->stack, sizeof(Value) * task->stackCount);
+    }
+    vm.stackTop = vm.stack + task->stackCount;
+    vm.budgeted = instructions != 0;
+    vm.budgetLeft = instructions;
+    vm.deadline = 0;
+    vm.resumable = true;
+    vm.task = task;
+
+    InterpretResult result = runVariant();
+    vm.resumable = false;
+    vm.task = NULL;
+    if (result != INTERPRET_YIELDED && (vm.diagnostics & DIAG_PROFILE)) {
+        dumpProfile();
+    }
+
+    if (result == INTERPRET_YIELDED) {
+        int count = (int)(vm.stackTop - vm.stack);
+        if (task->stackCapacity < count) {
+            int oldCapacity = task->stackCapacity;
+            task->stackCapacity = GROW_CAPACITY(count);
+            task->stack = GROW_ARRAY(Value, task->stack,
+                oldCapacity, task->stackCapacity);
+        }
+        if (count > 0) memcpy(task->stack, vm.stack, sizeof(Value) * count);
+        task->stackCount = count;
+        task->ip = vm.ip;
+    }
+    resetStack();
+    task->status = result;
     return result;
 }
 
+void freeTask(Task* task)
+{
+#ifdef DEBUG_TRACE_RING
+    // Records may point into the task's chunk and objects.
+    vm.traceCount = 0;
+#endif
+    freeChunk(&task->chunk);
+    freeTable(&task->strings);
+    freeObjectList(task->objects);
+    FREE_ARRAY(Value, task->stack, task->stackCapacity);
+    reallocate(task, sizeof(Task), 0);
+}
+
+/*
+* Element-wise arithmetic where at least one operand is an array: two
+* arrays of the same length, or an array and a number that is applied to
+* every element. Reports its own runtime errors.
+*/
+static bool arrayBinary(ArrayOp op, Value a, Value b, Value* result) {
+    bool aIsArray = IS_ARRAY(a);
+    bool bIsArray = IS_ARRAY(b);
+    if ((!aIsArray && !IS_NUMBER(a)) || (!bIsArray && !IS_NUMBER(b))) {
+        runtimeError("Operands must be numbers or arrays.");
+        return false;
+    }
+    if (aIsArray && bIsArray && AS_ARRAY(a)->count != AS_ARRAY(b)->count) {
+        runtimeError("Array lengths must match.");
+        return false;
+    }
+
+    double aNumber = aIsArray ? 0 : AS_NUMBER(a);
+    double bNumber = bIsArray ? 0 : AS_NUMBER(b);
+    const double* aValues = aIsArray ? AS_ARRAY(a)->values : &aNumber;
+    const double* bValues = bIsArray ? AS_ARRAY(b)->values : &bNumber;
+    int count = aIsArray ? AS_ARRAY(a)->count : AS_ARRAY(b)->count;
+    ObjArray* array = newArray(count);
+    arrayArithmetic(op, aValues, aIsArray, bValues, bIsArray,
+        array->values, count);
+    *result = OBJ_VAL(array);
+    return true;
+}
+
+/*
+* Checks made under DIAG_CHECKED before the instruction at vm.ip is traced
+* or run: it is a known opcode, its operand bytes and constant lie inside
+* the chunk, and the stack holds its inputs and has room for its result.
+* Reports its own runtime error.
+*/
+static bool checkInstruction(int depth) {
+    Chunk* chunk = vm.chunk;
+    uint8_t* instruction = vm.ip;
+    int remaining = (int)(chunk->code + chunk->count - instruction);
+    if (remaining <= 0) {
+        vm.ip = chunk->code + chunk->count;
+        runtimeError("Ran past the end of the chunk.");
+        return false;
+    }
+    // runtimeError() reports the line of the instruction before vm.ip.
+    vm.ip++;
+
+    int length = 1;
+    int inputs;
+    switch (*instruction) {
+        case OP_CONSTANT:
+            length = 2;
+            inputs = 0;
+            break;
+        case OP_ARRAY:
+            length = 2;
+            inputs = remaining >= 2 ? instruction[1] : 0;
+            break;
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_ADD_NN:
+        case OP_SUBTRACT_NN:
+        case OP_MULTIPLY_NN:
+        case OP_DIVIDE_NN:
+        case OP_DOT:
+            inputs = 2;
+            break;
+        case OP_NEGATE:
+        case OP_NEGATE_N:
+        case OP_SUM:
+        case OP_MIN:
+        case OP_MAX:
+        case OP_RETURN:
+            inputs = 1;
+            break;
+        default:
+            runtimeError("Unknown opcode %d.", *instruction);
+            return false;
+    }
+
+    if (length > remaining) {
+        runtimeError("Truncated instruction.");
+        return false;
+    }
+    if (*instruction == OP_CONSTANT &&
+        instruction[1] >= chunk->constants.count) {
+        runtimeError("Constant %d out of range.", instruction[1]);
+        return false;
+    }
+    if (depth < inputs) {
+        runtimeError("Stack underflow.");
+        return false;
+    }
+    if (depth - inputs + 1 > STACK_MAX) {
+        runtimeError("Stack overflow.");
+        return false;
+    }
+    vm.ip--;
+    return true;
+}
+
+/*
+* Compile-time switches for run(). Each combination is instantiated as its
+* own loop and runVariant() picks one from vm.diagnostics.
+*/
+template <bool Trace, bool Checked, bool Profile, bool Ring>
+struct RunPolicy {
+    static constexpr bool trace = Trace;
+    static constexpr bool checked = Checked;
+    static constexpr bool profile = Profile;
+    static constexpr bool ring = Ring;
+};
+
+template <typename Policy>
 static InterpretResult run() {
+    // The top of the stack lives in tos and the stack pointer in sp, so an
+    // instruction only touches memory for deeper slots. The slot under
+    // sp, sp[-1], is stale while tos is live; SPILL() writes it back and
+    // publishes sp before anything else looks at the stack.
+    Value* sp = vm.stackTop;
+    Value tos = sp[-1];
+
     #define READ_BYTE() \
             *vm.ip++
     #define READ_CONSTANT() (vm.chunk->constants.values[READ_BYTE()])
-    #define BINARY_OP(valueType, op) \
+    #define SPILL() \
+        do { \
+          sp[-1] = tos; \
+          vm.stackTop = sp; \
+        } while (false)
+    #define PUSH(value) \
         do { \
-          if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
+          sp[-1] = tos; \
+          tos = (value); \
+          sp++; \
+        } while (false)
+    #define BINARY_OP(valueType, op, intOp, arrayOp) \
+        do { \
+          Value a = sp[-2]; \
+          if (IS_INT(tos) && IS_INT(a)) { \
+            int64_t result; \
+            if (intOp(AS_INT(a), AS_INT(tos), &result)) { \
+              tos = INT_VAL(result); \
+              sp--; \
+              break; \
+            } \
+          } \
+          if (IS_ARRAY(a) || IS_ARRAY(tos)) { \
+            SPILL(); \
+            if (!arrayBinary(arrayOp, a, tos, &tos)) { \
+              return INTERPRET_RUNTIME_ERROR; \
+            } \
+            sp--; \
+            break; \
+          } \
+          if (!IS_NUMBER(tos) || !IS_NUMBER(a)) { \
+            SPILL(); \
             runtimeError("Operands must be numbers."); \
             return INTERPRET_RUNTIME_ERROR; \
           } \
-          double b = AS_NUMBER(pop()); \
-          double a = AS_NUMBER(pop()); \
-          push(valueType(a op b)); \
+          tos = valueType(AS_NUMBER(a) op AS_NUMBER(tos)); \
+          sp--; \
+        } while (false)
+
+    // Operands already known to be numbers; only the representation varies.
+    // The checked loop verifies that proof instead of trusting it.
+    #define NUMBER_OP(op, intOp) \
+        do { \
+          Value a = sp[-2]; \
+          if constexpr (Policy::checked) { \
+            if (!IS_NUMBER(tos) || !IS_NUMBER(a)) { \
+              SPILL(); \
+              runtimeError("Operands must be numbers."); \
+              return INTERPRET_RUNTIME_ERROR; \
+            } \
+          } \
+          int64_t result; \
+          if (IS_INT(tos) && IS_INT(a) && \
+              intOp(AS_INT(a), AS_INT(tos), &result)) { \
+            tos = INT_VAL(result); \
+          } \
+          else { \
+            tos = NUMBER_VAL(AS_NUMBER(a) op AS_NUMBER(tos)); \
+          } \
+          sp--; \
         } while (false)
 
+    // Check once before the first instruction, so that a pending interrupt
+    // stops even a run shorter than one slice.
+    uint32_t slice = 0;
+    uint32_t untilCheck = 0;
     for (;;) {
-        #ifdef DEBUG_TRACE_EXECUTION
-                printf("          stack:");
-                for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
-                    printf("[ ");
-                    printValue(*slot);
-                    printf(" ]");
-                }
-                printf("\n");
-                disassembleInstruction(vm.chunk,
-                    (int)(vm.ip - vm.chunk->code));
-        #endif
-        uint8_t instruction;
-        switch (instruction = READ_BYTE()) {
+        if (untilCheck == 0) {
+            if (vm.budgeted) vm.budgetLeft -= slice;
+            InterpretResult stop = preempted();
+            if (stop != INTERPRET_OK) SPILL();
+            if (stop == INTERPRET_YIELDED) return stop;
+            if (stop != INTERPRET_OK) {
+                runtimeError("Execution interrupted.");
+                return stop;
+            }
+            slice = untilCheck = nextSlice();
+        }
+        untilCheck--;
+        if constexpr (Policy::checked) {
+            SPILL();
+            if (!checkInstruction((int)(sp - vm.stack))) {
+                return INTERPRET_RUNTIME_ERROR;
+            }
+        }
+#ifdef DEBUG_TRACE_RING
+        if constexpr (Policy::ring) {
+            TraceRecord* record =
+                &vm.trace[vm.traceCount++ & (TRACE_RING_SIZE - 1)];
+            record->chunk = vm.chunk;
+            record->offset = (uint32_t)(vm.ip - vm.chunk->code);
+            record->depth = (uint16_t)(sp - vm.stack);
+            record->opcode = *vm.ip;
+            record->top = sp > vm.stack ? tos : NIL_VAL;
+        }
+#endif
+        if constexpr (Policy::trace) {
+            SPILL();
+            printf("          stack:");
+            for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
+                printf("[ ");
+                printValue(*slot);
+                printf(" ]");
+            }
+            printf("\n");
+            disassembleInstruction(vm.chunk,
+                (int)(vm.ip - vm.chunk->code));
+        }
+        uint8_t instruction = READ_BYTE();
+        if constexpr (Policy::profile) {
+            vm.profile[instruction]++;
+        }
+        switch (instruction) {
             case OP_CONSTANT: {
                 Value constant = READ_CONSTANT();
-                push(constant);
+                PUSH(constant);
                 printValue(constant);
                 printf("\n");
                 break;
             }
-            case OP_ADD:      BINARY_OP(NUMBER_VAL, +); break;
-            case OP_SUBTRACT: BINARY_OP(NUMBER_VAL, -); break;
-            case OP_MULTIPLY: BINARY_OP(NUMBER_VAL, *); break;
-            case OP_DIVIDE:   BINARY_OP(NUMBER_VAL, / ); break;
-            case OP_NEGATE:  
-                if (!IS_NUMBER(peek(0))) {
+            case OP_ADD: {
+                Value a = sp[-2];
+                int64_t result;
+                if (IS_INT(tos) && IS_INT(a) &&
+                    addInts(AS_INT(a), AS_INT(tos), &result)) {
+                    tos = INT_VAL(result);
+                }
+                else if (IS_STRING(tos) && IS_STRING(a)) {
+                    tos = OBJ_VAL(concatenateStrings(AS_STRING(a),
+                        AS_STRING(tos)));
+                }
+                else if (IS_NUMBER(tos) && IS_NUMBER(a)) {
+                    tos = NUMBER_VAL(AS_NUMBER(a) + AS_NUMBER(tos));
+                }
+                else if (IS_ARRAY(tos) || IS_ARRAY(a)) {
+                    SPILL();
+                    if (!arrayBinary(ARRAY_ADD, a, tos, &tos)) {
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                }
+                else {
+                    SPILL();
+                    runtimeError(
+                        "Operands must be two numbers or two strings.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                sp--;
+                break;
+            }
+            case OP_SUBTRACT:
+                BINARY_OP(NUMBER_VAL, -, subtractInts, ARRAY_SUBTRACT);
+                break;
+            case OP_MULTIPLY:
+                BINARY_OP(NUMBER_VAL, *, multiplyInts, ARRAY_MULTIPLY);
+                break;
+            case OP_DIVIDE:
+                BINARY_OP(NUMBER_VAL, /, divideInts, ARRAY_DIVIDE);
+                break;
+            case OP_NEGATE: {
+                int64_t result;
+                if (IS_INT(tos) && negateInt(AS_INT(tos), &result)) {
+                    tos = INT_VAL(result);
+                    break;
+                }
+                if (IS_ARRAY(tos)) {
+                    ObjArray* operand = AS_ARRAY(tos);
+                    ObjArray* array = newArray(operand->count);
+                    arrayNegate(operand->values, array->values, operand->count);
+                    tos = OBJ_VAL(array);
+                    break;
+                }
+                if (!IS_NUMBER(tos)) {
+                    SPILL();
                     runtimeError("Operand must be a number.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                *(vm.stackTop - 1) = NUMBER_VAL(-AS_NUMBER(*(vm.stackTop - 1)));
+                tos = NUMBER_VAL(-AS_NUMBER(tos));
                 break;
+            }
+            case OP_ADD_NN:      NUMBER_OP(+, addInts); break;
+            case OP_SUBTRACT_NN: NUMBER_OP(-, subtractInts); break;
+            case OP_MULTIPLY_NN: NUMBER_OP(*, multiplyInts); break;
+            case OP_DIVIDE_NN:   NUMBER_OP(/, divideInts); break;
+            case OP_NEGATE_N: {
+                if constexpr (Policy::checked) {
+                    if (!IS_NUMBER(tos)) {
+                        SPILL();
+                        runtimeError("Operand must be a number.");
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                }
+                int64_t result;
+                if (IS_INT(tos) && negateInt(AS_INT(tos), &result)) {
+                    tos = INT_VAL(result);
+                }
+                else {
+                    tos = NUMBER_VAL(-AS_NUMBER(tos));
+                }
+                break;
+            }
+            case OP_ARRAY: {
+                int count = READ_BYTE();
+                SPILL();
+                Value* elements = sp - count;
+                for (int i = 0; i < count; i++) {
+                    if (!IS_NUMBER(elements[i])) {
+                        runtimeError("Array elements must be numbers.");
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                }
+                ObjArray* array = newArray(count);
+                for (int i = 0; i < count; i++) {
+                    array->values[i] = AS_NUMBER(elements[i]);
+                }
+                sp = elements;
+                tos = sp[-1];
+                PUSH(OBJ_VAL(array));
+                break;
+            }
+            case OP_SUM:
+            case OP_MIN:
+            case OP_MAX: {
+                if (!IS_ARRAY(tos)) {
+                    SPILL();
+                    runtimeError("Operand must be an array.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                ObjArray* array = AS_ARRAY(tos);
+                if (instruction == OP_SUM) {
+                    tos = NUMBER_VAL(arraySum(array->values, array->count));
+                    break;
+                }
+                if (array->count == 0) {
+                    SPILL();
+                    runtimeError("Array must not be empty.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                tos = NUMBER_VAL(instruction == OP_MIN
+                    ? arrayMin(array->values, array->count)
+                    : arrayMax(array->values, array->count));
+                break;
+            }
+            case OP_DOT: {
+                Value a = sp[-2];
+                if (!IS_ARRAY(a) || !IS_ARRAY(tos)) {
+                    SPILL();
+                    runtimeError("Operands must be arrays.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if (AS_ARRAY(a)->count != AS_ARRAY(tos)->count) {
+                    SPILL();
+                    runtimeError("Array lengths must match.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                tos = NUMBER_VAL(arrayDot(AS_ARRAY(a)->values,
+                    AS_ARRAY(tos)->values, AS_ARRAY(a)->count));
+                sp--;
+                break;
+            }
             case OP_RETURN: {
-                printValue(pop());
+                sp--;
+                vm.stackTop = sp;
+                printValue(tos);
                 printf("\n");
                 return INTERPRET_OK;
             }
@@ -122,6 +628,115 @@ static InterpretResult run() {
     }
     #undef READ_BYTE
     #undef READ_CONSTANT
+    #undef SPILL
+    #undef PUSH
     #undef BINARY_OP
+    #undef NUMBER_OP
+}
+
+typedef InterpretResult (*RunFn)();
+
+// Indexed by vm.diagnostics & DIAG_RUN_VARIANTS.
+static const RunFn runVariants[DIAG_RUN_VARIANTS + 1] = {
+    run<RunPolicy<false, false, false, false>>,
+    run<RunPolicy<true,  false, false, false>>,
+    run<RunPolicy<false, true,  false, false>>,
+    run<RunPolicy<true,  true,  false, false>>,
+    run<RunPolicy<false, false, true,  false>>,
+    run<RunPolicy<true,  false, true,  false>>,
+    run<RunPolicy<false, true,  true,  false>>,
+    run<RunPolicy<true,  true,  true,  false>>,
+    run<RunPolicy<false, false, false, true>>,
+    run<RunPolicy<true,  false, false, true>>,
+    run<RunPolicy<false, true,  false, true>>,
+    run<RunPolicy<true,  true,  false, true>>,
+    run<RunPolicy<false, false, true,  true>>,
+    run<RunPolicy<true,  false, true,  true>>,
+    run<RunPolicy<false, true,  true,  true>>,
+    run<RunPolicy<true,  true,  true,  true>>,
+};
+
+static InterpretResult runVariant() {
+    InterpretResult result = runVariants[vm.diagnostics & DIAG_RUN_VARIANTS]();
+    vm.interruptRequested.store(false, std::memory_order_relaxed);
+    // The chunk may die with the caller's frame or its task, and dumpTrace()
+    // must not decode it from a signal handler afterwards.
+    vm.chunk = NULL;
+    return result;
+}
+
+/*
+* Number of instructions run() may execute before it next calls preempted().
+* Never overshoots the instruction budget.
+*/
+static uint32_t nextSlice() {
+    if (vm.budgeted && vm.budgetLeft < PREEMPT_CHECK_INTERVAL) {
+        return (uint32_t)vm.budgetLeft;
+    }
+    return PREEMPT_CHECK_INTERVAL;
+}
+
+/*
+* INTERPRET_OK to keep going, otherwise the reason to stop. A task whose
+* slice has run out is parked rather than interrupted.
+*/
+static InterpretResult preempted() {
+    if (vm.interruptRequested.exchange(false, std::memory_order_relaxed)) {
+        return INTERPRET_INTERRUPTED;
+    }
+    if (vm.budgeted && vm.budgetLeft == 0) {
+        return vm.resumable ? INTERPRET_YIELDED : INTERPRET_INTERRUPTED;
+    }
+    if (vm.deadline != 0 && monotonicMillis() >= vm.deadline) {
+        return INTERPRET_INTERRUPTED;
+    }
+    return INTERPRET_OK;
 }
 
+/*
+* Decode the trace ring, oldest record first. Only records from the chunk
+* being run are shown: those from other tasks may refer to freed chunks.
+*/
+void dumpTrace()
+{
+#ifdef DEBUG_TRACE_RING
+    if (vm.chunk == NULL || !(vm.diagnostics & DIAG_RING)) return;
+    uint64_t count = vm.traceCount < TRACE_RING_SIZE
+        ? vm.traceCount : TRACE_RING_SIZE;
+    // stderr, so the dump never mixes into the script's own output.
+    fflush(stdout);
+    fprintf(stderr, "== trace (last %d instructions) ==\n", (int)count);
+    for (uint64_t i = vm.traceCount - count; i < vm.traceCount; i++) {
+        TraceRecord* record = &vm.trace[i & (TRACE_RING_SIZE - 1)];
+        if (record->chunk != vm.chunk ||
+            record->offset >= (uint32_t)vm.chunk->count) {
+            continue;
+        }
+        fprintf(stderr, "%5d [ ", record->depth);
+        printValue(record->top, stderr);
+        fputs(" ] ", stderr);
+        disassembleInstruction(record->chunk, (int)record->offset, stderr);
+    }
+    fputs("== end ==\n", stderr);
+    fflush(stderr);
+#endif
+}
+
+/*
+* Print the instruction counts gathered under DIAG_PROFILE to stderr and
+* start counting afresh.
+*/
+void dumpProfile()
+{
+    uint64_t total = 0;
+    for (int i = 0; i <= UINT8_MAX; i++) total += vm.profile[i];
+    fprintf(stderr, "== profile (%llu instructions) ==\n",
+        (unsigned long long)total);
+    for (int i = 0; i <= UINT8_MAX; i++) {
+        if (vm.profile[i] == 0) continue;
+        fprintf(stderr, "%-16s %12llu %6.2f%%\n", opcodeName((uint8_t)i),
+            (unsigned long long)vm.profile[i], 100.0 * vm.profile[i] / total);
+    }
+    fprintf(stderr, "== end ==\n");
+    memset(vm.profile, 0, sizeof(vm.profile));
+}
@@ -2,32 +2,137 @@
 #ifndef clox_vm_h
 #define clox_vm_h
 
+#include <atomic>
+
 #include "chunk.h"
+#include "table.h"
 #include "value.h"
 
 #define STACK_MAX 256
+// Instructions executed between checks of the interrupt flag, the
+// instruction budget and the deadline.
+#define PREEMPT_CHECK_INTERVAL 1024
+
+// One executed instruction, recorded before it runs.
+typedef struct {
+	Chunk* chunk;
+	uint32_t offset;
+	uint16_t depth;
+	uint8_t opcode;
+	Value top;
+} TraceRecord;
+
+/*
+* Diagnostics chosen at runtime with setDiagnostics(). run() is compiled
+* once per combination of the first four, so those that are off cost
+* nothing in the loop that runs. DIAG_RING is on after initVM() when
+* DEBUG_TRACE_RING is defined, and does nothing otherwise.
+*/
+typedef enum {
+	DIAG_TRACE      = 1 << 0, // Print the stack and each instruction.
+	DIAG_CHECKED    = 1 << 1, // Validate bytecode and the compiler's type proofs.
+	DIAG_PROFILE    = 1 << 2, // Count executed instructions by opcode.
+	DIAG_RING       = 1 << 3, // Record each instruction in the trace ring.
+	DIAG_PRINT_CODE = 1 << 4, // Disassemble each chunk after compiling.
+} Diagnostic;
+
+#define DIAG_RUN_VARIANTS (DIAG_TRACE | DIAG_CHECKED | DIAG_PROFILE | DIAG_RING)
 
+struct Task;
+
+/*
+* There is one VM per process and it is not thread-safe: the stack, the
+* heap, the interned strings and the trace ring are all shared. Tasks let
+* one thread interleave many scripts; resumeTask() and every other call
+* here must come from that thread. Only interruptVM() may be called from
+* elsewhere.
+*/
 typedef struct {
 	Chunk* chunk;
 	uint8_t* ip;
-	Value stack[STACK_MAX];
+	// stack[-1] is a spare slot for run(), which caches the top of the
+	// stack in a local and spills it to stackTop[-1], even when empty.
+	Value stackSlots[STACK_MAX + 1];
+	Value* stack;
 	Value* stackTop;
+	Table strings;
+	Obj* objects;
+	// The task being compiled or run. Objects made meanwhile go on its own
+	// list and strings are interned in its own table, so freeTask() can
+	// release them.
+	struct Task* task;
+	// Limits applied to each interpret(); 0 means unlimited.
+	uint64_t instructionBudget;
+	uint64_t timeLimitMillis;
+	// State of the current run.
+	bool budgeted;
+	uint64_t budgetLeft;
+	uint64_t deadline;
+	// Running a Task: an exhausted budget parks it instead of failing.
+	bool resumable;
+	std::atomic<bool> interruptRequested;
+	uint32_t diagnostics;
+	// Executed instructions per opcode under DIAG_PROFILE.
+	uint64_t profile[UINT8_MAX + 1];
+#ifdef DEBUG_TRACE_RING
+	// Ring buffer of the last TRACE_RING_SIZE instructions. traceCount
+	// never wraps, so it also tells how much of the ring is filled.
+	TraceRecord trace[TRACE_RING_SIZE];
+	uint64_t traceCount;
+#endif
 } VM;
 
 typedef enum {
 	INTERPRET_OK,
 	INTERPRET_COMPILE_ERROR,
-	INTERPRET_RUNTIME_ERROR
+	INTERPRET_RUNTIME_ERROR,
+	INTERPRET_INTERRUPTED,
+	INTERPRET_YIELDED
 } InterpretResult;
+
+/*
+* A compiled script that runs in slices. Between slices the task owns its
+* chunk, its ip and a copy of the live part of its stack, so the VM is free
+* to run other tasks. Parked tasks cost only what they keep on the stack
+* and the objects they have made.
+*/
+typedef struct Task {
+	Chunk chunk;
+	uint8_t* ip;
+	int stackCount;
+	int stackCapacity;
+	Value* stack;
+	// INTERPRET_YIELDED until the task has run to completion or failed.
+	InterpretResult status;
+	Obj* objects;
+	Table strings;
+} Task;
+
+extern VM vm;
+
 void initVM();
 void freeVM();
+void setInstructionBudget(uint64_t instructions);
+void setTimeLimit(uint64_t milliseconds);
+void interruptVM();
+void setDiagnostics(uint32_t diagnostics);
+void dumpTrace();
+void dumpProfile();
+
+Task* newTask(const char* source);
+InterpretResult resumeTask(Task* task, uint32_t instructions);
+void freeTask(Task* task);
 
 static void resetStack();
 static void runtimeError(const char* format, ...);
 void push(Value value);
 Value pop();
-static Value peek(int distance);
 
 InterpretResult interpret(const char* source);
+InterpretResult interpretChunk(Chunk* chunk);
+template <typename Policy>
 static InterpretResult run();
+static InterpretResult runVariant();
+static uint32_t nextSlice();
+static InterpretResult preempted();
 #endif